@@ -0,0 +1,373 @@
+/*******************************************************************************
+
+"A Collection of Useful C++ Classes for Digital Signal Processing"
+ By Vinnie Falco
+
+Official project location:
+https://github.com/vinniefalco/DSPFilters
+
+See Documentation.cpp for contact information, notes, and bibliography.
+
+--------------------------------------------------------------------------------
+
+License: MIT License (http://www.opensource.org/licenses/mit-license.php)
+Copyright (c) 2009 by Vinnie Falco
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef DSPFILTERS_BLOCKSTATE_H
+#define DSPFILTERS_BLOCKSTATE_H
+
+#include "DspFilters/Common.h"
+#include "DspFilters/Biquad.h"
+#include "DspFilters/MathSupplement.h"
+#include "DspFilters/ParallelState.h"
+#include "DspFilters/State.h"
+
+#include <algorithm>
+
+// Asks for a loop to be unrolled completely, so that arrays of SIMD packs
+// indexed by its counter can live in registers.
+#if defined(__clang__)
+#  define DSPFILTERS_UNROLL _Pragma ("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#  define DSPFILTERS_UNROLL _Pragma ("GCC unroll 16")
+#else
+#  define DSPFILTERS_UNROLL
+#endif
+
+namespace Dsp {
+
+/*
+ * Block state
+ *
+ * Passing BlockDirectFormII as the StateType of a FilterDesign, SimpleFilter
+ * or SmoothedFilterDesign runs each channel through the filter several
+ * samples at a time. It is meant for long single channels, where
+ * ParallelDirectFormII has no lanes to fill.
+ *
+ * A Direct Form II section feeds every sample back into the next one, so
+ * sample by sample it runs at the latency of that recursion. Unrolled over
+ * a block of blockSize samples it becomes
+ *
+ *   y[k] = sum h[k-j] x[j] + d1[k] w[-1] + d2[k] w[-2],   0 <= j <= k
+ *
+ * where h is the impulse response of the section and d1, d2 are its
+ * responses to the state at the start of the block. The sum depends on
+ * the input alone and vectorizes across the block. The state at the end
+ * of the block, w[blockSize-1] and w[blockSize-2], follows from the input
+ * and the state at the start in the same way; that small step is all
+ * that one block waits for from the one before.
+ *
+ * The state is that of DirectFormII and it gets the same anti-denormal
+ * constant, so the output equals DirectFormII's to within rounding. Samples
+ * processed one at a time, as SmoothedFilterDesign does during a
+ * transition, go through the DirectFormII recursion itself.
+ *
+ */
+struct BlockDirectFormII
+{
+};
+
+// State of one channel.
+class BlockDirectFormIIState
+{
+public:
+  enum
+  {
+    blockSize = 8,     // samples per step of the unrolled recursion
+    chunkSize = 256    // samples converted to double at a time
+  };
+
+  BlockDirectFormIIState ()
+    : m_vsa (anti_denormal_vsa)
+  {
+  }
+
+  void reset ()
+  {
+    std::fill (m_v.begin (), m_v.end (), 0.);
+  }
+
+  // One sample through every section, exactly as DirectFormII.
+  template <typename Sample, class Filter>
+  Sample process (const Sample in, const Filter& filter)
+  {
+    const int numStages = detail::stageCount (filter);
+    reserve (numStages);
+
+    double out = in;
+    double vsa = 0;
+    if (!ScopedFlushToZero::isActive ())
+      vsa = m_vsa = -m_vsa;
+    for (int i = 0; i < numStages; ++i, vsa = 0)
+    {
+      const BiquadBase& s = detail::stageAt (filter, i);
+      double* v = &m_v[2 * i];
+
+      double w = out - s.m_a1*v[0] - s.m_a2*v[1] + vsa;
+      out =            s.m_b0*w    + s.m_b1*v[0] + s.m_b2*v[1];
+
+      v[1] = v[0];
+      v[0] = w;
+    }
+    return static_cast<Sample> (out);
+  }
+
+  // A block of samples through every section, blockSize at a time.
+  template <typename Sample, class Filter>
+  void process (int numSamples, Sample* dest, const Filter& filter)
+  {
+    const int numStages = detail::stageCount (filter);
+    reserve (numStages);
+
+    for (int i = 0; i < numStages; ++i)
+      m_stages[i].setup (detail::stageAt (filter, i));
+
+    // no constant to inject while the hardware flushes denormals
+    const bool inject = !ScopedFlushToZero::isActive ();
+
+    while (numSamples > 0)
+    {
+      const int n = std::min (int (chunkSize), numSamples);
+
+      if (inject)
+      {
+        // DirectFormII adds the constant to w of the first section, which
+        // is the same as adding it to the input
+        double vsa = m_vsa;
+        for (int i = 0; i < n; ++i)
+        {
+          vsa = -vsa;
+          m_chunk[i] = dest[i] + vsa;
+        }
+        m_vsa = vsa;
+      }
+      else
+      {
+        for (int i = 0; i < n; ++i)
+          m_chunk[i] = dest[i];
+      }
+
+      for (int i = 0; i < numStages; ++i)
+        m_stages[i].process (n, m_chunk, &m_v[2 * i]);
+
+      for (int i = 0; i < n; ++i)
+        dest[i] = static_cast<Sample> (m_chunk[i]);
+
+      dest += n;
+      numSamples -= n;
+    }
+  }
+
+private:
+  // The unrolled recursion of one section. A block computes its outputs
+  // and the state at its end together, as one column of rows values that
+  // is worked on a SIMD pack at a time.
+  struct Stage
+  {
+    enum
+    {
+      rows = blockSize + 2,                 // y[0 .. blockSize-1], w[-1], w[-2]
+      packs = (rows + detail::packLanes - 1) / detail::packLanes,
+      outputPacks = blockSize / detail::packLanes,
+      stride = packs * detail::packLanes
+    };
+
+    void setup (const BiquadBase& s)
+    {
+      a1 = s.m_a1;
+      a2 = s.m_a2;
+      b0 = s.m_b0;
+      b1 = s.m_b1;
+      b2 = s.m_b2;
+
+      // w[k] after an impulse at x[0] (g), and after w[-1] = 1 (c1) and
+      // w[-2] = 1 (c2) with no input; index k + 2 holds w[k]
+      double g[blockSize + 2];
+      double c1[blockSize + 2];
+      double c2[blockSize + 2];
+      g[0] = 0;  g[1] = 0;
+      c1[0] = 0; c1[1] = 1;
+      c2[0] = 1; c2[1] = 0;
+      for (int k = 2; k < blockSize + 2; ++k)
+      {
+        g[k] = (k == 2 ? 1 : 0) - a1*g[k - 1] - a2*g[k - 2];
+        c1[k] = -a1*c1[k - 1] - a2*c1[k - 2];
+        c2[k] = -a1*c2[k - 1] - a2*c2[k - 2];
+      }
+
+      for (int k = 0; k < stride; ++k)
+      {
+        d1[k] = 0;
+        d2[k] = 0;
+        for (int j = 0; j < blockSize; ++j)
+          H[j][k] = 0;
+      }
+
+      // y[k] = b0 w[k] + b1 w[k-1] + b2 w[k-2]
+      for (int k = 0; k < blockSize; ++k)
+      {
+        d1[k] = b0*c1[k + 2] + b1*c1[k + 1] + b2*c1[k];
+        d2[k] = b0*c2[k + 2] + b1*c2[k + 1] + b2*c2[k];
+        for (int j = 0; j <= k; ++j)
+        {
+          const int m = k - j + 2;
+          H[j][k] = b0*g[m] + b1*g[m - 1] + b2*g[m - 2];
+        }
+      }
+
+      // the new w[-1] and w[-2] are w[blockSize-1] and w[blockSize-2]
+      for (int r = 0; r < 2; ++r)
+      {
+        const int k = blockSize + r;
+        const int last = blockSize - 1 - r;
+        d1[k] = c1[last + 2];
+        d2[k] = c2[last + 2];
+        for (int j = 0; j <= last; ++j)
+          H[j][k] = g[last - j + 2];
+      }
+    }
+
+    void process (int numSamples, double* x, double* v)
+    {
+      using namespace detail;
+
+      double v1 = v[0];
+      double v2 = v[1];
+
+      int i = 0;
+      for (; i + blockSize <= numSamples; i += blockSize)
+      {
+        double* const in = x + i;
+
+        // the part that depends on the input only; the outputs before x[j]
+        // do not depend on it
+        pack_t y[packs];
+        DSPFILTERS_UNROLL
+        for (int p = 0; p < packs; ++p)
+          y[p] = packMul (packLoad (H[0] + p*packLanes), packSet (in[0]));
+        DSPFILTERS_UNROLL
+        for (int j = 1; j < blockSize; ++j)
+        {
+          const pack_t xj = packSet (in[j]);
+          DSPFILTERS_UNROLL
+          for (int p = j / packLanes; p < packs; ++p)
+            y[p] = packAdd (y[p], packMul (packLoad (H[j] + p*packLanes), xj));
+        }
+
+        // then the state at the start of the block, the only dependency
+        // from one block to the next
+        const pack_t s1 = packSet (v1);
+        const pack_t s2 = packSet (v2);
+        double next[stride - blockSize];
+        DSPFILTERS_UNROLL
+        for (int p = 0; p < packs; ++p)
+        {
+          const pack_t out = packAdd (y[p], packAdd (packMul (packLoad (d1 + p*packLanes), s1),
+                                                     packMul (packLoad (d2 + p*packLanes), s2)));
+          if (p < outputPacks)
+            packStore (in + p*packLanes, out);
+          else
+            packStore (next + (p - outputPacks)*packLanes, out);
+        }
+        v1 = next[0];
+        v2 = next[1];
+      }
+
+      // the rest of the chunk one sample at a time
+      for (; i < numSamples; ++i)
+      {
+        const double w = x[i] - a1*v1 - a2*v2;
+        x[i] = b0*w + b1*v1 + b2*v2;
+        v2 = v1;
+        v1 = w;
+      }
+
+      v[0] = v1;
+      v[1] = v2;
+    }
+
+    double a1, a2, b0, b1, b2;
+    double d1[stride];
+    double d2[stride];
+    double H[blockSize][stride];
+  };
+
+  void reserve (int numStages)
+  {
+    if (int (m_stages.size ()) < numStages)
+    {
+      m_stages.resize (numStages);
+      m_v.resize (2 * numStages, 0.);
+    }
+  }
+
+  double m_vsa;
+  std::vector<double> m_v;  // v[-1], v[-2] of each section
+  std::vector<Stage> m_stages;
+  double m_chunk[chunkSize];
+};
+
+// Holds the block states of all channels.
+template <int Channels>
+class BlockChannelsState
+{
+public:
+  int getNumChannels() const
+  {
+    return Channels;
+  }
+
+  void reset ()
+  {
+    for (int i = 0; i < Channels; ++i)
+      m_state[i].reset();
+  }
+
+  BlockDirectFormIIState& operator[] (int index)
+  {
+    assert (index >= 0 && index < Channels);
+    return m_state[index];
+  }
+
+  template <class Filter, typename Sample>
+  void process (int numSamples,
+                Sample* const* arrayOfChannels,
+                Filter& filter)
+  {
+    for (int i = 0; i < Channels; ++i)
+      m_state[i].process (numSamples, arrayOfChannels[i], filter);
+  }
+
+private:
+  BlockDirectFormIIState m_state[Channels];
+};
+
+template <int Channels, class DesignClass>
+struct ChannelsStateFor <Channels, DesignClass, BlockDirectFormII>
+{
+  typedef BlockChannelsState <Channels> type;
+};
+
+}
+
+#endif
@@ -104,9 +104,17 @@ public:
     return m_numStages;
   }
 
-  const Stage& operator[] (int index)
+  const Stage& operator[] (int index) const
   {
-    assert (index >= 0 && index <= m_numStages);
+    assert (index >= 0 && index < m_numStages);
+    return m_stageArray[index];
+  }
+
+  // For code that sets the coefficients of the sections directly, like
+  // the interpolation of SmoothedFilterDesign.
+  Stage& operator[] (int index)
+  {
+    assert (index >= 0 && index < m_numStages);
     return m_stageArray[index];
   }
 
@@ -176,6 +184,20 @@ private:
   Cascade::Stage m_stages[MaxStages];
 };
 
+//------------------------------------------------------------------------------
+
+namespace detail {
+
+// Uniform access to the sections of single biquad and cascade designs.
+inline int stageCount (const Cascade& c) { return c.getNumStages (); }
+inline const BiquadBase& stageAt (const Cascade& c, int i) { return c[i]; }
+inline BiquadBase& stageAt (Cascade& c, int i) { return c[i]; }
+inline int stageCount (const BiquadBase&) { return 1; }
+inline const BiquadBase& stageAt (const BiquadBase& b, int) { return b; }
+inline BiquadBase& stageAt (BiquadBase& b, int) { return b; }
+
+}
+
 }
 
 #endif
@@ -0,0 +1,334 @@
+/*******************************************************************************
+
+"A Collection of Useful C++ Classes for Digital Signal Processing"
+ By Vinnie Falco
+
+Official project location:
+https://github.com/vinniefalco/DSPFilters
+
+See Documentation.cpp for contact information, notes, and bibliography.
+
+--------------------------------------------------------------------------------
+
+License: MIT License (http://www.opensource.org/licenses/mit-license.php)
+Copyright (c) 2009 by Vinnie Falco
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef DSPFILTERS_DECIMATOR_H
+#define DSPFILTERS_DECIMATOR_H
+
+#include "DspFilters/Common.h"
+#include "DspFilters/MathSupplement.h"
+
+namespace Dsp {
+
+/*
+ * Multi-stage decimation by a power of two
+ *
+ * A decimation by 2^k runs k - 1 CIC halving stages followed by one
+ * compensating FIR halving stage. Each CIC stage is the non-recursive form
+ * (1 + z^-1)^Order / 2^Order, evaluated only for the samples it keeps; in
+ * this form nothing grows without bound, so it works in floating point
+ * where the integrator/comb form would not.
+ *
+ * The CIC stages are cheap but droop across the passband and let through
+ * some of what folds into it. The last stage is a polyphase FIR whose
+ * response is the inverse of that droop, within 0.6 dB, up to 0.4 times the
+ * output Nyquist frequency. Above that it has a wide transition band: it is
+ * down about 16 dB at 0.9, 35 dB at 1.0, 48 dB at 1.1 and 90 dB at 1.2 times
+ * the output Nyquist frequency. What folds into the passband is down by
+ * 64 dB or more, but the upper part of the output band is not alias free:
+ * a component just above the output Nyquist frequency lands just below it.
+ * Use the output up to 0.4 of its Nyquist frequency, or low-pass it there.
+ * The FIR's even and odd taps run on the even and odd input samples, so
+ * only the samples that are kept are ever computed.
+ *
+ * Processing is in place: process() writes the decimated samples to the
+ * start of each channel and returns how many it wrote. The phase of the
+ * decimation carries over between calls, so the output does not depend on
+ * how the input is split into blocks.
+ *
+ */
+template <int Channels, int Order = 4>
+class Decimator
+{
+public:
+  enum
+  {
+    maxStages = 10,   // decimation up to 1024
+    firTaps = 48      // taps of the compensating FIR, even
+  };
+
+  Decimator ()
+    : m_ratio (1)
+    , m_stages (0)
+  {
+    reset ();
+  }
+
+  int getRatio () const
+  {
+    return m_ratio;
+  }
+
+  // Ratio must be a power of two from 1 to 2^maxStages. Resets the state.
+  void setup (int ratio)
+  {
+    int stages = 0;
+    while ((1 << stages) < ratio && stages < maxStages)
+      ++stages;
+
+    assert ((1 << stages) == ratio);
+
+    m_ratio = 1 << stages;
+    m_stages = stages;
+    if (m_stages > 0)
+      design ();
+    reset ();
+  }
+
+  void reset ()
+  {
+    for (int s = 0; s < maxStages; ++s)
+    {
+      m_cicPhase[s] = 0;
+      for (int i = 0; i < Channels; ++i)
+        for (int j = 0; j < Order; ++j)
+          m_cicHistory[s][i][j] = 0;
+    }
+
+    m_firPhase = 0;
+    m_firPos = 0;
+    for (int i = 0; i < Channels; ++i)
+      for (int p = 0; p < 2; ++p)
+        for (int j = 0; j < firTaps; ++j)
+          m_firLine[i][p][j] = 0;
+  }
+
+  template <typename Sample>
+  int process (int numSamples, Sample* const* arrayOfChannels)
+  {
+    if (m_stages == 0)
+      return numSamples;
+
+    int n = numSamples;
+    for (int s = 0; s < m_stages - 1; ++s)
+      n = processCic (s, n, arrayOfChannels);
+    return processFir (n, arrayOfChannels);
+  }
+
+private:
+  enum { phaseTaps = firTaps / 2 };
+
+  // One CIC halving stage. Keeps the input samples at odd phase, and only
+  // evaluates the filter for those. Output k is written over input k or
+  // earlier, which the filter has already read once n > 2 * Order; the
+  // first outputs read a copy of the history and the start of the block.
+  template <typename Sample>
+  int processCic (int stage, int numSamples, Sample* const* arrayOfChannels)
+  {
+    enum { headSize = 2 * Order + 2 };
+
+    const int phase = m_cicPhase[stage];
+    const int first = 1 - phase;
+    const int kept = numSamples > first ? (numSamples - first + 1) / 2 : 0;
+    const int head = numSamples < headSize ? numSamples : headSize;
+
+    for (int i = 0; i < Channels; ++i)
+    {
+      Sample* const dest = arrayOfChannels[i];
+      double* const h = m_cicHistory[stage][i];
+
+      double x[Order + headSize];
+      for (int j = 0; j < Order; ++j)
+        x[Order - 1 - j] = h[j];
+      for (int n = 0; n < head; ++n)
+        x[Order + n] = dest[n];
+
+      // the history for the next call, before the block is overwritten
+      double next[Order];
+      for (int j = 0; j < Order; ++j)
+        next[j] = j < numSamples ? double (dest[numSamples - 1 - j]) : h[j - numSamples];
+
+      int k = 0;
+      int n = first;
+      for (; k < kept && n < head; ++k, n += 2)
+      {
+        double y = 0;
+        for (int j = 0; j <= Order; ++j)
+          y += m_cicTaps[j] * x[Order + n - j];
+        dest[k] = Sample (y * m_cicScale);
+      }
+      for (; k < kept; ++k, n += 2)
+      {
+        double y = 0;
+        for (int j = 0; j <= Order; ++j)
+          y += m_cicTaps[j] * dest[n - j];
+        dest[k] = Sample (y * m_cicScale);
+      }
+
+      for (int j = 0; j < Order; ++j)
+        h[j] = next[j];
+    }
+
+    m_cicPhase[stage] = (phase + numSamples) & 1;
+    return kept;
+  }
+
+  // The compensating FIR, y[m] = sum h[t] x[2m - t], split into the even
+  // taps on the even input samples and the odd taps on the odd ones. The
+  // delay lines are stored twice over so the newest phaseTaps samples are
+  // always contiguous.
+  template <typename Sample>
+  int processFir (int numSamples, Sample* const* arrayOfChannels)
+  {
+    const int phase = m_firPhase;
+    const int pos = m_firPos;
+    int kept = 0;
+    int p = pos;
+
+    for (int i = 0; i < Channels; ++i)
+    {
+      Sample* const dest = arrayOfChannels[i];
+      double* const odd = m_firLine[i][1];
+      double* const even = m_firLine[i][0];
+      kept = 0;
+      p = pos;
+
+      for (int n = 0; n < numSamples; ++n)
+      {
+        const double x = dest[n];
+        if (((phase + n) & 1) == 0)
+        {
+          // newest odd sample is x[2m - 1]; store at p, read from p
+          odd[p] = odd[p + phaseTaps] = x;
+          continue;
+        }
+
+        even[p] = even[p + phaseTaps] = x;
+
+        double y = 0;
+        const double* e = even + p;
+        const double* o = odd + p;
+        for (int j = 0; j < phaseTaps; ++j)
+          y += m_firEven[j] * e[j] + m_firOdd[j] * o[j];
+        dest[kept++] = Sample (y);
+
+        p = (p == 0) ? phaseTaps - 1 : p - 1;
+      }
+    }
+
+    m_firPhase = (phase + numSamples) & 1;
+    m_firPos = p;
+    return kept;
+  }
+
+  // Designs the compensating FIR for the current number of CIC stages by
+  // frequency sampling: the wanted response is sampled on a dense grid,
+  // transformed back with linear phase and shaped with a Blackman window.
+  // Frequencies are in cycles per FIR input sample, so the FIR output
+  // Nyquist frequency is at 0.25.
+  void design ()
+  {
+    // binomial taps of (1 + z^-1)^Order
+    m_cicTaps[0] = 1;
+    for (int j = 1; j <= Order; ++j)
+    {
+      m_cicTaps[j] = 0;
+      for (int k = j; k > 0; --k)
+        m_cicTaps[k] += m_cicTaps[k - 1];
+    }
+    m_cicScale = 1. / (1 << Order);
+
+    const double passEdge = 0.1;
+    const double stopEdge = 0.25;
+    const int gridSize = 1024;
+    const double center = (firTaps - 1) / 2.;
+
+    double taps[firTaps];
+    for (int t = 0; t < firTaps; ++t)
+      taps[t] = 0;
+
+    for (int g = 0; g <= gridSize / 2; ++g)
+    {
+      const double f = double (g) / gridSize;
+
+      double gain;
+      if (f <= passEdge)
+        gain = 1 / cicResponse (f);
+      else if (f < stopEdge)
+        gain = (stopEdge - f) / (stopEdge - passEdge) / cicResponse (passEdge);
+      else
+        break;
+
+      const double weight = (g == 0) ? 1 : 2;
+      for (int t = 0; t < firTaps; ++t)
+        taps[t] += weight * gain * std::cos (2 * doublePi * f * (t - center));
+    }
+
+    double sum = 0;
+    for (int t = 0; t < firTaps; ++t)
+    {
+      const double x = 2 * doublePi * t / (firTaps - 1);
+      taps[t] *= 0.42 - 0.5 * std::cos (x) + 0.08 * std::cos (2 * x);
+      sum += taps[t];
+    }
+
+    // unity gain at DC
+    for (int j = 0; j < phaseTaps; ++j)
+    {
+      m_firEven[j] = taps[2 * j] / sum;
+      m_firOdd[j] = taps[2 * j + 1] / sum;
+    }
+  }
+
+  // magnitude of the CIC stages ahead of the FIR at frequency f
+  double cicResponse (double f) const
+  {
+    double gain = 1;
+    for (int s = 1; s < m_stages; ++s)
+    {
+      const double c = std::cos (doublePi * f / (1 << s));
+      for (int j = 0; j < Order; ++j)
+        gain *= c;
+    }
+    return gain;
+  }
+
+  int m_ratio;
+  int m_stages;
+
+  double m_cicTaps[Order + 1];
+  double m_cicScale;
+  double m_firEven[phaseTaps];
+  double m_firOdd[phaseTaps];
+
+  int m_cicPhase[maxStages];
+  double m_cicHistory[maxStages][Channels][Order];
+  int m_firPhase;
+  int m_firPos;
+  double m_firLine[Channels][2][firTaps];
+};
+
+}
+
+#endif
@@ -43,8 +43,11 @@ THE SOFTWARE.
 #include "DspFilters/Common.h"
 
 #include "DspFilters/Biquad.h"
+#include "DspFilters/BlockState.h"
 #include "DspFilters/Cascade.h"
+#include "DspFilters/Decimator.h"
 #include "DspFilters/Filter.h"
+#include "DspFilters/ParallelState.h"
 #include "DspFilters/PoleFilter.h"
 #include "DspFilters/SmoothedFilter.h"
 #include "DspFilters/State.h"
@@ -224,8 +224,7 @@ public:
   }
 
 protected:
-  ChannelsState <Channels,
-                 typename DesignClass::template State <StateType> > m_state;
+  typename ChannelsStateFor <Channels, DesignClass, StateType>::type m_state;
 };
 
 //------------------------------------------------------------------------------
@@ -260,8 +259,7 @@ public:
   }
 
 protected:
-  ChannelsState <Channels,
-                 typename FilterClass::template State <StateType> > m_state;
+  typename ChannelsStateFor <Channels, FilterClass, StateType>::type m_state;
 };
 
 }
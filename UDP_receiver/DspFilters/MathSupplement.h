@@ -38,6 +38,13 @@ THE SOFTWARE.
 
 #include "DspFilters/Common.h"
 
+// The control register of SSE holds the flush-to-zero mode of the double
+// arithmetic only if that arithmetic runs on SSE2 rather than x87.
+#if defined(__SSE2_MATH__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <xmmintrin.h>
+#  define DSPFILTERS_HAVE_MXCSR
+#endif
+
 namespace Dsp {
 
 const double doublePi		=3.1415926535897932384626433832795028841971;
@@ -116,6 +123,71 @@ inline bool is_nan<complex_t> (complex_t v)
 
 //------------------------------------------------------------------------------
 
+/*
+ * Hardware flush-to-zero for the current thread
+ *
+ * While an object of this class is alive, the thread computes with
+ * flush-to-zero (results too small to be normal become zero) and
+ * denormals-are-zero (denormal operands read as zero) set in the SSE
+ * control register; the previous mode comes back on destruction, so
+ * guards nest. A decaying filter then reaches exact zero instead of
+ * crawling through the denormal range, which is what DenormalPrevention
+ * otherwise has to prevent with its injected constant. The states ask
+ * isActive () and leave the constant out while a guard is alive.
+ *
+ * Reading and writing the control register costs some tens of cycles, so
+ * put the guard around a call that processes a block, not around every
+ * sample. Where the double arithmetic does not run on SSE this does
+ * nothing and isActive () stays false.
+ */
+class ScopedFlushToZero
+{
+public:
+  ScopedFlushToZero ()
+    : m_wasActive (active ())
+  {
+#ifdef DSPFILTERS_HAVE_MXCSR
+    m_csr = _mm_getcsr ();
+    _mm_setcsr (m_csr | flushBits);
+    active () = true;
+#endif
+  }
+
+  ~ScopedFlushToZero ()
+  {
+#ifdef DSPFILTERS_HAVE_MXCSR
+    _mm_setcsr (m_csr);
+    active () = m_wasActive;
+#endif
+  }
+
+  // true while a guard is alive on the calling thread
+  static inline bool isActive ()
+  {
+    return active ();
+  }
+
+private:
+  ScopedFlushToZero (const ScopedFlushToZero&);
+  ScopedFlushToZero& operator= (const ScopedFlushToZero&);
+
+  enum
+  {
+    flushBits = 0x8040  // FTZ | DAZ
+  };
+
+  static inline bool& active ()
+  {
+    static thread_local bool flag = false;
+    return flag;
+  }
+
+  unsigned int m_csr;
+  bool m_wasActive;
+};
+
+//------------------------------------------------------------------------------
+
 /*
  * Hack to prevent denormals
  *
@@ -133,9 +205,12 @@ public:
   {
   }
 
-  // small alternating current
+  // small alternating current, or none while the hardware flushes
+  // denormals (see ScopedFlushToZero)
   inline double ac ()
   {
+    if (ScopedFlushToZero::isActive ())
+      return 0;
     return m_v = -m_v;
   }
 
@@ -0,0 +1,269 @@
+/*******************************************************************************
+
+"A Collection of Useful C++ Classes for Digital Signal Processing"
+ By Vinnie Falco
+
+Official project location:
+https://github.com/vinniefalco/DSPFilters
+
+See Documentation.cpp for contact information, notes, and bibliography.
+
+--------------------------------------------------------------------------------
+
+License: MIT License (http://www.opensource.org/licenses/mit-license.php)
+Copyright (c) 2009 by Vinnie Falco
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*******************************************************************************/
+
+#ifndef DSPFILTERS_PARALLELSTATE_H
+#define DSPFILTERS_PARALLELSTATE_H
+
+#include "DspFilters/Common.h"
+#include "DspFilters/Biquad.h"
+#include "DspFilters/Cascade.h"
+#include "DspFilters/MathSupplement.h"
+#include "DspFilters/State.h"
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define DSPFILTERS_PARALLEL_SSE2
+#endif
+
+namespace Dsp {
+
+/*
+ * Channel-parallel state
+ *
+ * Passing ParallelDirectFormII as the StateType of a FilterDesign or a
+ * SimpleFilter filters all of its channels together, one channel per SIMD
+ * lane: four with AVX, two with SSE2 and one in the scalar fallback.
+ *
+ * The channels are interleaved a block at a time and the block is run
+ * through one stage after the other, the groups of lanes of a sample all
+ * stepped together. The lane width is fixed at compile time. A default
+ * x86-64 build gets SSE2, where 4 and 8 channels take about half the time
+ * of as many DirectFormII channels but the cost still grows linearly.
+ * With AVX (-mavx, CONFIG+=avx in the receiver's .pro) 4 channels cost
+ * about 1.6 times one and 8 about 2.5 times. A single channel has nothing
+ * to share a pack with and gets a plain DirectFormII state instead.
+ *
+ * The arithmetic is that of DirectFormII, in the same order and with the
+ * same anti-denormal constant, so each channel comes out as it would from
+ * a DirectFormII filter of its own.
+ *
+ * SmoothedFilterDesign steps the channel states one at a time during a
+ * transition and cannot be used with this state type.
+ *
+ */
+struct ParallelDirectFormII
+{
+};
+
+namespace detail {
+
+#if defined(__AVX__)
+
+typedef __m256d pack_t;
+const int packLanes = 4;
+
+inline pack_t packLoad (const double* p) { return _mm256_loadu_pd (p); }
+inline void packStore (double* p, pack_t v) { _mm256_storeu_pd (p, v); }
+inline pack_t packSet (double x) { return _mm256_set1_pd (x); }
+inline pack_t packAdd (pack_t a, pack_t b) { return _mm256_add_pd (a, b); }
+inline pack_t packSub (pack_t a, pack_t b) { return _mm256_sub_pd (a, b); }
+inline pack_t packMul (pack_t a, pack_t b) { return _mm256_mul_pd (a, b); }
+
+#elif defined(DSPFILTERS_PARALLEL_SSE2)
+
+typedef __m128d pack_t;
+const int packLanes = 2;
+
+inline pack_t packLoad (const double* p) { return _mm_loadu_pd (p); }
+inline void packStore (double* p, pack_t v) { _mm_storeu_pd (p, v); }
+inline pack_t packSet (double x) { return _mm_set1_pd (x); }
+inline pack_t packAdd (pack_t a, pack_t b) { return _mm_add_pd (a, b); }
+inline pack_t packSub (pack_t a, pack_t b) { return _mm_sub_pd (a, b); }
+inline pack_t packMul (pack_t a, pack_t b) { return _mm_mul_pd (a, b); }
+
+#else
+
+typedef double pack_t;
+const int packLanes = 1;
+
+inline pack_t packLoad (const double* p) { return *p; }
+inline void packStore (double* p, pack_t v) { *p = v; }
+inline pack_t packSet (double x) { return x; }
+inline pack_t packAdd (pack_t a, pack_t b) { return a + b; }
+inline pack_t packSub (pack_t a, pack_t b) { return a - b; }
+inline pack_t packMul (pack_t a, pack_t b) { return a * b; }
+
+#endif
+
+}
+
+template <int Channels>
+class ParallelChannelsState
+{
+public:
+  enum
+  {
+    groups = (Channels + detail::packLanes - 1) / detail::packLanes,
+    width = groups * detail::packLanes, // values per interleaved sample
+    blockSize = 64                      // samples interleaved at a time
+  };
+
+  ParallelChannelsState ()
+    : m_numStages (0)
+    , m_vsa (anti_denormal_vsa)
+  {
+    // the lanes past the last channel stay zero
+    for (int i = 0; i < blockSize * width; ++i)
+      m_block[i] = 0;
+  }
+
+  int getNumChannels() const
+  {
+    return Channels;
+  }
+
+  void reset ()
+  {
+    std::fill (m_v.begin (), m_v.end (), 0.);
+  }
+
+  template <class Filter, typename Sample>
+  void process (int numSamples,
+                Sample* const* arrayOfChannels,
+                Filter& filter)
+  {
+    const int numStages = detail::stageCount (filter);
+    if (numStages > m_numStages)
+    {
+      m_v.resize (2 * numStages * width, 0.);
+      m_numStages = numStages;
+    }
+
+    // no constant to inject while the hardware flushes denormals
+    const bool inject = !ScopedFlushToZero::isActive ();
+
+    for (int start = 0; start < numSamples; start += blockSize)
+    {
+      const int n = std::min (int (blockSize), numSamples - start);
+
+      for (int c = 0; c < Channels; ++c)
+      {
+        const Sample* src = arrayOfChannels[c] + start;
+        for (int i = 0; i < n; ++i)
+          m_block[i * width + c] = src[i];
+      }
+
+      for (int s = 0; s < numStages; ++s)
+        processStage (n, detail::stageAt (filter, s), &m_v[2 * s * width], inject && s == 0);
+
+      for (int c = 0; c < Channels; ++c)
+      {
+        Sample* dest = arrayOfChannels[c] + start;
+        for (int i = 0; i < n; ++i)
+          dest[i] = static_cast<Sample> (m_block[i * width + c]);
+      }
+    }
+  }
+
+private:
+  // Runs n interleaved samples through one section. The recursions of
+  // the groups are independent, so each fills the latency of the others.
+  void processStage (int n, const BiquadBase& s, double* state, bool inject)
+  {
+    using namespace detail;
+
+    const pack_t a1 = packSet (s.m_a1);
+    const pack_t a2 = packSet (s.m_a2);
+    const pack_t b0 = packSet (s.m_b0);
+    const pack_t b1 = packSet (s.m_b1);
+    const pack_t b2 = packSet (s.m_b2);
+
+    pack_t v1[groups];
+    pack_t v2[groups];
+    for (int g = 0; g < groups; ++g)
+    {
+      v1[g] = packLoad (state + g * packLanes);
+      v2[g] = packLoad (state + width + g * packLanes);
+    }
+
+    // the alternating constant of DenormalPrevention; only the first
+    // section gets it, and none while the hardware flushes denormals
+    double ac = m_vsa;
+
+    double* frame = m_block;
+    for (int i = 0; i < n; ++i, frame += width)
+    {
+      if (inject)
+        ac = -ac;
+      const pack_t vsa = packSet (inject ? ac : 0.);
+
+      for (int g = 0; g < groups; ++g)
+      {
+        const pack_t in = packLoad (frame + g * packLanes);
+        const pack_t w = packAdd (packSub (packSub (in, packMul (a1, v1[g])),
+                                           packMul (a2, v2[g])), vsa);
+        const pack_t out = packAdd (packAdd (packMul (b0, w),
+                                             packMul (b1, v1[g])), packMul (b2, v2[g]));
+        v2[g] = v1[g];
+        v1[g] = w;
+        packStore (frame + g * packLanes, out);
+      }
+    }
+
+    for (int g = 0; g < groups; ++g)
+    {
+      packStore (state + g * packLanes, v1[g]);
+      packStore (state + width + g * packLanes, v2[g]);
+    }
+    m_vsa = ac;
+  }
+
+  int m_numStages;
+  double m_vsa;
+  std::vector<double> m_v;  // v[-1] then v[-2] of every lane, per section
+  double m_block[blockSize * width];
+};
+
+template <int Channels, class DesignClass>
+struct ChannelsStateFor <Channels, DesignClass, ParallelDirectFormII>
+{
+  typedef ParallelChannelsState <Channels> type;
+};
+
+// One lane would only add the interleaving; DirectFormII is faster.
+template <class DesignClass>
+struct ChannelsStateFor <1, DesignClass, ParallelDirectFormII>
+{
+  typedef ChannelsState <1,
+                         typename DesignClass::template State <DirectFormII> > type;
+};
+
+}
+
+#endif
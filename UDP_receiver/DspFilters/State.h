@@ -316,6 +316,15 @@ public:
   }
 };
 
+// Selects the container that holds the channel states of a design. State
+// types that process all channels at once specialize this.
+template <int Channels, class DesignClass, class StateType>
+struct ChannelsStateFor
+{
+  typedef ChannelsState <Channels,
+                         typename DesignClass::template State <StateType> > type;
+};
+
 //------------------------------------------------------------------------------
 
 }
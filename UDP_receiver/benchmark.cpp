@@ -0,0 +1,552 @@
+#include <QElapsedTimer>
+#include <QVector>
+#include <qmath.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "benchmark.h"
+#include "fft.h"
+#include "iqdemodulator.h"
+#include "dsppipeline.h"
+#include "DspFilters/Dsp.h"
+
+// Keeps the compiler from dropping a result that is never used otherwise.
+static volatile double sink;
+
+/*
+ * fft_sim/simfft.py times 100 scipy rfft calls on a 1024 point sine and
+ * prints the total in seconds; the first line here is the same measurement
+ * so the two can be compared directly. The per-transform times below it
+ * are averaged over enough calls to be stable.
+ */
+static void benchmarkFft()
+{
+	const int maxLen = 1024;
+	const double Fs = 100;
+	const double f_t = 5;
+
+	QVector<double> s0(maxLen);
+	for (int i = 0; i < maxLen; ++i)
+		s0[i] = qSin(2 * M_PI * f_t * i / Fs);
+
+	Fft fft(maxLen);
+	QVector<double> re(fft.realBins()), im(fft.realBins());
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < 100; ++i)
+		fft.forwardReal(s0.constData(), re.data(), im.data());
+	printf("rfft %d points, 100 calls (as simfft.py): %.6f s\n", maxLen, timer.nsecsElapsed() / 1e9);
+	sink = re[5];
+
+	const int sizes[] = { 256, 1000, 1024, 4096 };
+	for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		const int n = sizes[s];
+		QVector<double> in(n), outRe(n), outIm(n), zero(n);
+		for (int i = 0; i < n; ++i)
+			in[i] = qSin(2 * M_PI * f_t * i / Fs);
+
+		Fft transform(n);
+		const int calls = qMax(100, 20000000 / (n * 10));
+
+		timer.start();
+		for (int i = 0; i < calls; ++i)
+			transform.forwardReal(in.constData(), outRe.data(), outIm.data());
+		const double realUs = timer.nsecsElapsed() / 1e3 / calls;
+		sink = outRe[1];
+
+		timer.start();
+		for (int i = 0; i < calls; ++i)
+			transform.forward(in.constData(), zero.constData(), outRe.data(), outIm.data());
+		const double complexUs = timer.nsecsElapsed() / 1e3 / calls;
+		sink = outRe[1];
+
+		printf("fft %5d points: real %8.2f us, complex %8.2f us\n", n, realUs, complexUs);
+	}
+}
+
+/*
+ * The demodulator has to keep up with the scope on one core; this reports
+ * its throughput on a carrier with a Doppler offset, fed in pipeline-sized
+ * blocks.
+ */
+static void benchmarkDemodulator()
+{
+	const double sampleRate = 10e6;
+	const int count = 1 << 22;
+	const int block = 4096;
+
+	QVector<double> in(count);
+	for (int i = 0; i < count; ++i)
+		in[i] = qCos(2 * M_PI * 40050 * i / sampleRate);
+
+	IqDemodulator demodulator;
+	demodulator.setParams(sampleRate, 40000, 1000, 16);
+	SampleRing<double> outI, outQ;
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < count; i += block)
+		demodulator.process(in.constData() + i, block, outI, outQ);
+	const double seconds = timer.nsecsElapsed() / 1e9;
+	sink = outI.data()[0];
+
+	printf("I/Q demodulator: %.1f MS/s\n", count / seconds / 1e6);
+}
+
+/*
+ * Cost of the low-pass at the end of the mixing chain per input sample,
+ * run at the full rate and behind the decimator at some of the ratios the
+ * GUI offers.
+ */
+static void benchmarkDecimation()
+{
+	const double sampleRate = 100000;
+	const int count = 1 << 22;
+	const int block = 4096;
+
+	QVector<double> in(count);
+	for (int i = 0; i < count; ++i)
+		in[i] = qCos(2 * M_PI * 50 * i / sampleRate) * qCos(2 * M_PI * 40000 * i / sampleRate);
+	QVector<double> work(block);
+
+	for (int ratio = 1; ratio <= 64; ratio *= 4)
+	{
+		Dsp::Decimator<1> decimator;
+		decimator.setup(ratio);
+		Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::LowPass, 1> lowPass(1024);
+		Dsp::Params params;
+		params[0] = sampleRate / ratio;
+		params[1] = 100;
+		params[2] = 0.3;
+		lowPass.setParams(params);
+
+		QElapsedTimer timer;
+		timer.start();
+		for (int i = 0; i < count; i += block)
+		{
+			memcpy(work.data(), in.constData() + i, block * sizeof(double));
+			double *channels[1] = { work.data() };
+			const int kept = decimator.process(block, channels);
+			lowPass.process(kept, channels);
+		}
+		const double seconds = timer.nsecsElapsed() / 1e9;
+		sink = work[0];
+
+		printf("decimate by %2d + low-pass: %.1f MS/s\n", ratio, count / seconds / 1e6);
+	}
+}
+
+/*
+ * A 4th order Butterworth low-pass over 1, 4 and 8 channels, one state per
+ * channel against the channel-parallel state. The time is for one sample
+ * on every channel, so the parallel state should stay close to flat.
+ */
+template <int Channels, class StateType>
+static double channelFilterNs()
+{
+	const int count = 1 << 20;
+	const int block = 4096;
+
+	Dsp::SimpleFilter<Dsp::Butterworth::LowPass<4>, Channels, StateType> filter;
+	filter.setup(4, 100000, 100);
+
+	QVector<double> data[Channels];
+	double *channels[Channels];
+	for (int c = 0; c < Channels; ++c)
+	{
+		data[c].resize(block);
+		for (int i = 0; i < block; ++i)
+			data[c][i] = qSin(0.01 * (c + 1) * i);
+		channels[c] = data[c].data();
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < count; i += block)
+		filter.process(block, channels);
+	const double ns = timer.nsecsElapsed();
+	sink = data[0][0];
+
+	return ns / count;
+}
+
+static void benchmarkChannels()
+{
+	printf("butterworth 4, ns per frame    1 ch    4 ch    8 ch\n");
+	printf("  DirectFormII               %6.2f  %6.2f  %6.2f\n",
+		   channelFilterNs<1, Dsp::DirectFormII>(),
+		   channelFilterNs<4, Dsp::DirectFormII>(),
+		   channelFilterNs<8, Dsp::DirectFormII>());
+	printf("  ParallelDirectFormII       %6.2f  %6.2f  %6.2f\n",
+		   channelFilterNs<1, Dsp::ParallelDirectFormII>(),
+		   channelFilterNs<4, Dsp::ParallelDirectFormII>(),
+		   channelFilterNs<8, Dsp::ParallelDirectFormII>());
+}
+
+/*
+ * One channel through a filter sample by sample in DirectFormII and
+ * several samples at a time in BlockDirectFormII. The last column is the
+ * largest difference between the two outputs, relative to the largest
+ * output; the two are meant to be numerically equivalent, so anything
+ * above 1e-10 fails the run.
+ */
+template <class Serial, class Block>
+static bool blockFilterRun(const char *name, Serial &serial, Block &block)
+{
+	const int count = 1 << 22;
+	const int size = 4096;
+
+	QVector<double> in(size), a(size), b(size);
+	for (int i = 0; i < size; ++i)
+		in[i] = 1000 * qSin(2 * M_PI * 50 * i / 100000) + (i * 7919 % 101 - 50);
+	double *channelA[1] = { a.data() };
+	double *channelB[1] = { b.data() };
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < count; i += size)
+	{
+		memcpy(a.data(), in.constData(), size * sizeof(double));
+		serial.process(size, channelA);
+	}
+	const double serialNs = double(timer.nsecsElapsed()) / count;
+
+	timer.start();
+	for (int i = 0; i < count; i += size)
+	{
+		memcpy(b.data(), in.constData(), size * sizeof(double));
+		block.process(size, channelB);
+	}
+	const double blockNs = double(timer.nsecsElapsed()) / count;
+
+	double diff = 0, peak = 0;
+	for (int i = 0; i < size; ++i)
+	{
+		diff = qMax(diff, qAbs(a[i] - b[i]));
+		peak = qMax(peak, qAbs(a[i]));
+	}
+	sink = b[0];
+
+	const bool equivalent = diff <= 1e-10 * peak;
+	printf("  %-22s %6.2f  %6.2f  %4.1fx  %.1e%s\n", name, serialNs, blockNs, serialNs / blockNs, diff / peak,
+		   equivalent ? "" : "  FAILED");
+	return equivalent;
+}
+
+static bool benchmarkBlockFilter()
+{
+	printf("one channel, ns/sample    DF II   block  speedup  difference\n");
+
+	Dsp::Params params;
+	params[0] = 100000;
+	params[1] = 1000;
+	params[2] = 0.3;
+	Dsp::FilterDesign<Dsp::RBJ::Design::HighPass, 1> highPass;
+	Dsp::FilterDesign<Dsp::RBJ::Design::HighPass, 1, Dsp::BlockDirectFormII> highPassBlock;
+	highPass.setParams(params);
+	highPassBlock.setParams(params);
+	bool ok = blockFilterRun("RBJ high-pass 1 kHz", highPass, highPassBlock);
+
+	Dsp::SimpleFilter<Dsp::Butterworth::LowPass<4>, 1> lowPass;
+	Dsp::SimpleFilter<Dsp::Butterworth::LowPass<4>, 1, Dsp::BlockDirectFormII> lowPassBlock;
+	lowPass.setup(4, 100000, 100);
+	lowPassBlock.setup(4, 100000, 100);
+	ok &= blockFilterRun("butterworth 4, 100 Hz", lowPass, lowPassBlock);
+	return ok;
+}
+
+/*
+ * Runs reps transitions of the pipeline's high-pass between Q 0.3 and
+ * 0.3 + QStep, each over one block of 1024 samples, redesigning every
+ * controlInterval samples; with a QStep of 0 the filter stays fixed.
+ * Returns the time per sample in ns and the last block in out.
+ */
+static double transitionRun(int controlInterval, double QStep, QVector<double> &out)
+{
+	const int size = 1024;
+	const int reps = 2000;
+
+	QVector<double> in(size);
+	for (int i = 0; i < size; ++i)
+		in[i] = 1000 * qSin(2 * M_PI * 3000 * i / 100000) + (i * 7919 % 101 - 50);
+	out = in;
+	double *channels[1] = { out.data() };
+
+	Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::HighPass, 1, Dsp::BlockDirectFormII> filter(size, controlInterval);
+	Dsp::Params params;
+	params[0] = 100000;
+	params[1] = 1000;
+	params[2] = 0.3;
+	filter.setParams(params);
+
+	QElapsedTimer timer;
+	qint64 ns = 0;
+	for (int r = 0; r < reps; ++r)
+	{
+		if (QStep != 0)
+		{
+			// back and forth, as Key_E and Key_R do
+			params[2] = r % 2 ? 0.3 : 0.3 + QStep;
+			filter.setParams(params);
+		}
+		memcpy(out.data(), in.constData(), size * sizeof(double));
+		timer.start();
+		filter.process(size, channels);
+		ns += timer.nsecsElapsed();
+	}
+	return double(ns) / (reps * size);
+}
+
+/*
+ * Cost of a parameter transition of SmoothedFilterDesign against the fixed
+ * filter, and how far interpolating the coefficients between redesigns
+ * moves the output from a redesign on every sample.
+ */
+static void benchmarkSmoothing()
+{
+	printf("Q transitions, ns/sample   fixed  every 1  every 8  every 32  difference\n");
+
+	QVector<double> fixed, exact, out8, out32;
+	const double fixedNs = transitionRun(1, 0, fixed);
+	const double exactNs = transitionRun(1, 0.1, exact);
+	const double ns8 = transitionRun(8, 0.1, out8);
+	const double ns32 = transitionRun(32, 0.1, out32);
+
+	double diff = 0, peak = 0;
+	for (int i = 0; i < exact.size(); ++i)
+	{
+		diff = qMax(diff, qMax(qAbs(out8[i] - exact[i]), qAbs(out32[i] - exact[i])));
+		peak = qMax(peak, qAbs(exact[i]));
+	}
+	printf("  RBJ high-pass 1 kHz     %6.2f  %7.2f  %7.2f  %8.2f  %.1e\n", fixedNs, exactNs, ns8, ns32, diff / peak);
+}
+
+/*
+ * Rings a filter down from an impulse on silence for count samples; returns
+ * the time per sample in ns and the magnitude of the last output in last.
+ */
+template <class Filter>
+static double decayRun(Filter &filter, double &last)
+{
+	const int count = 1 << 20;
+	const int size = 4096;
+
+	QVector<double> work(size);
+	double *channels[1] = { work.data() };
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < count; i += size)
+	{
+		work.fill(0);
+		if (i == 0)
+			work[0] = 1000;
+		filter.process(size, channels);
+	}
+	const double ns = double(timer.nsecsElapsed()) / count;
+	last = qAbs(work[size - 1]);
+	return ns;
+}
+
+/*
+ * Left alone, a decaying filter spends most of its time in the slow
+ * denormal range. Both ways of preventing that should keep silence as
+ * cheap as signal: the alternating constant the states inject, and
+ * Dsp::ScopedFlushToZero, under which the states leave the constant out
+ * and decay to exact zero.
+ */
+static void benchmarkDenormals()
+{
+	printf("decay to silence, ns/sample    constant  flush to zero\n");
+
+	double last = 0, flushLast = 0;
+	Dsp::SimpleFilter<Dsp::Butterworth::LowPass<4>, 1> a, b;
+	a.setup(4, 100000, 100);
+	b.setup(4, 100000, 100);
+	double ns = decayRun(a, last);
+	double flushNs;
+	{
+		Dsp::ScopedFlushToZero flushToZero;
+		flushNs = decayRun(b, flushLast);
+	}
+	printf("  butterworth 4, DF II        %6.2f %6.2f    (last %.0e, %.0e)\n", ns, flushNs, last, flushLast);
+
+	Dsp::SimpleFilter<Dsp::Butterworth::LowPass<4>, 1, Dsp::BlockDirectFormII> c, d;
+	c.setup(4, 100000, 100);
+	d.setup(4, 100000, 100);
+	ns = decayRun(c, last);
+	{
+		Dsp::ScopedFlushToZero flushToZero;
+		flushNs = decayRun(d, flushLast);
+	}
+	printf("  butterworth 4, block        %6.2f %6.2f    (last %.0e, %.0e)\n", ns, flushNs, last, flushLast);
+}
+
+/*
+ * Feeds count samples of the two channels through a pipeline in blocks the
+ * size of a few datagrams, as the ingest thread would, and returns the time
+ * per input sample in ns.
+ */
+template <typename Sample>
+static double pipelineRun(const QVector<double> &T, const QVector<double> &ra,
+	SampleRing<Sample> &ringT, SampleRing<Sample> &ringRa, BasicDspPipeline<Sample> &pipeline)
+{
+	const int count = T.size();
+	const int block = 4096;
+
+	pipeline.setParams(100000, 0.3);
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < count; i += block)
+	{
+		ringT.push(T.constData() + i, block);
+		ringRa.push(ra.constData() + i, block);
+		pipeline.process();
+	}
+	return double(timer.nsecsElapsed()) / count;
+}
+
+// largest difference between the latest count samples of the two rings,
+// relative to the largest sample of the double one
+static double ringDifference(const SampleRing<double> &a, const SampleRing<float> &b, int count)
+{
+	QVector<double> x(count), y(count);
+	a.latest(count).copyTo(x.data());
+	b.latest(count).copyTo(y.data());
+
+	double diff = 0, peak = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		diff = qMax(diff, qAbs(x[i] - y[i]));
+		peak = qMax(peak, qAbs(x[i]));
+	}
+	return diff / peak;
+}
+
+/*
+ * The whole mixing chain in double and in float (CONFIG+=float_samples) on
+ * the same stream: the transmit reference in T and a Doppler shifted echo
+ * plus some low frequency pickup in ra, in millivolts as NetworkController
+ * delivers them. Both runs must agree to well below the resolution of a
+ * 12 bit ADC for the float build to be usable; the spectrum is compared in
+ * dB over the bins within 60 dB of each column's peak. A ring more than
+ * 1e-5 off or a spectrum more than 1e-3 dB off fails the run.
+ */
+static bool benchmarkSamplePrecision()
+{
+	const double sampleRate = 100000;
+	const int count = 1 << 21;
+
+	QVector<double> T(count), ra(count);
+	for (int i = 0; i < count; ++i)
+	{
+		T[i] = 1000 * qCos(2 * M_PI * 40000 * i / sampleRate);
+		ra[i] = 250 * (8 * qCos(2 * M_PI * 40050 * i / sampleRate)
+			+ 3 * qSin(2 * M_PI * 120 * i / sampleRate) + (qint64(i) * 7919 % 101 - 50) / 50.0);
+	}
+
+	SampleRing<double> doubleT, doubleRa;
+	BasicDspPipeline<double> doublePipeline(doubleT, doubleRa);
+	const double doubleNs = pipelineRun(T, ra, doubleT, doubleRa, doublePipeline);
+
+	SampleRing<float> floatT, floatRa;
+	BasicDspPipeline<float> floatPipeline(floatT, floatRa);
+	const double floatNs = pipelineRun(T, ra, floatT, floatRa, floatPipeline);
+
+	printf("pipeline, ns/sample: double %.1f, float %.1f\n", doubleNs, floatNs);
+
+	const int window = 1 << 16;
+	const double rings[] = {
+		ringDifference(doublePipeline.out_T, floatPipeline.out_T, window),
+		ringDifference(doublePipeline.out_ra, floatPipeline.out_ra, window),
+		ringDifference(doublePipeline.out_rb, floatPipeline.out_rb, window / doublePipeline.decimation()),
+		ringDifference(doublePipeline.out_I, floatPipeline.out_I, window / DspPipeline::DemodDecimation),
+		ringDifference(doublePipeline.out_Q, floatPipeline.out_Q, window / DspPipeline::DemodDecimation)
+	};
+	const bool ringsOk = *std::max_element(rings, rings + 5) <= 1e-5;
+	printf("  float vs double   out_T %.1e  out_ra %.1e  out_rb %.1e  out_I %.1e  out_Q %.1e%s\n",
+		rings[0], rings[1], rings[2], rings[3], rings[4], ringsOk ? "" : "  FAILED");
+
+	const int bins = doublePipeline.spectrumBins();
+	const int columns = 16;
+	QVector<double> x(bins * columns), y(bins * columns);
+	doublePipeline.out_spectrum.latest(bins * columns).copyTo(x.data());
+	floatPipeline.out_spectrum.latest(bins * columns).copyTo(y.data());
+	double dB = 0;
+	for (int c = 0; c < columns; ++c)
+	{
+		const double *column = x.constData() + c * bins;
+		const double peak = *std::max_element(column, column + bins);
+		for (int k = 0; k < bins; ++k)
+		{
+			if (column[k] > peak - 60)
+				dB = qMax(dB, qAbs(column[k] - y[c * bins + k]));
+		}
+	}
+	const bool spectrumOk = dB <= 1e-3;
+	printf("  spectrum: %.1e dB%s\n", dB, spectrumOk ? "" : "  FAILED");
+	return ringsOk && spectrumOk;
+}
+
+/*
+ * A sample that, as push() converts it into the ring, checks whether views
+ * of the ring starting at oldStart and newStart are still intact. It lets
+ * the check run while the producer is in the middle of writing.
+ */
+struct TornReadProbe
+{
+	const SampleRing<double> *ring;
+	uint64_t oldStart;
+	uint64_t newStart;
+	bool *oldIntact;
+	bool *newIntact;
+
+	operator double() const
+	{
+		*oldIntact = ring->isIntact(oldStart);
+		*newIntact = ring->isIntact(newStart);
+		return 0;
+	}
+};
+
+/*
+ * SampleRing::isIntact must report a view as torn as soon as a push() that
+ * overwrites part of it has started, not only once that push() has
+ * published its samples. A full ring of 16 gets 4 more samples: the view
+ * of all 16 loses its first 4 to them, the view of the last 12 does not.
+ */
+static bool checkTornRead()
+{
+	SampleRing<double> ring(4);
+	double filler[16] = {};
+	ring.push(filler, 16);
+	const SampleRing<double>::View all = ring.latest(16);
+	const SampleRing<double>::View recent = ring.latest(12);
+
+	bool oldIntact = true, newIntact = false;
+	const TornReadProbe probe = { &ring, all.start, recent.start, &oldIntact, &newIntact };
+	const TornReadProbe samples[4] = { probe, probe, probe, probe };
+	ring.push(samples, 4);
+
+	const bool ok = !oldIntact && newIntact && !ring.isIntact(all) && ring.isIntact(recent);
+	printf("SampleRing torn read during push: %s\n", ok ? "detected" : "missed  FAILED");
+	return ok;
+}
+
+int runBenchmarks()
+{
+	bool ok = true;
+	ok &= checkTornRead();
+	benchmarkFft();
+	benchmarkDemodulator();
+	benchmarkDecimation();
+	benchmarkChannels();
+	ok &= benchmarkBlockFilter();
+	benchmarkSmoothing();
+	benchmarkDenormals();
+	ok &= benchmarkSamplePrecision();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/*
+ * Timing runs of the receiver's signal processing, started with
+ *
+ *    multicastreceiver --bench
+ *
+ * instead of the GUI. The results go to stdout; nothing is sent or
+ * received on the network. Returns nonzero if a result that is checked
+ * (marked FAILED in the output) is out of tolerance.
+ */
+int runBenchmarks();
+
+#endif
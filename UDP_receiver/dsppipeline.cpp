@@ -0,0 +1,212 @@
+#include "dsppipeline.h"
+
+template <typename Sample>
+BasicDspPipeline<Sample>::BasicDspPipeline(SampleRing<Sample> &T, SampleRing<Sample> &ra)
+	: in_T(T)
+	, in_ra(ra)
+	, highPassFilter(1024, 32)
+	, lowPassFilter(1024, 32)
+	, spectrogram(SpectrumSize, SpectrumHop, SpectrumDecimation / DefaultDecimation)
+	, designedSampleRate(0)
+	, designedQFactor(0)
+	, carrier(40000)
+	, highPass(true)
+	, lowPass(true)
+	, inputNext(0)
+	, mixNext(0)
+	, spectrumNext(0)
+	, skipped(0)
+	, block_a(BlockSize)
+	, block_b(BlockSize)
+{
+	decimator.setup(DefaultDecimation);
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::setParams(int sampleRate, double QFactor)
+{
+	if (sampleRate == designedSampleRate && QFactor == designedQFactor)
+		return;
+
+	Dsp::Params paramsHigh;
+	paramsHigh[0] = sampleRate; // sample rate
+	paramsHigh[1] = 1000; // cutoff frequency
+	paramsHigh[2] = QFactor; // Q
+	highPassFilter.setParams (paramsHigh);
+
+	demodulator.setParams(sampleRate, carrier, DemodCutoff, DemodDecimation);
+
+	designedSampleRate = sampleRate;
+	designedQFactor = QFactor;
+	designLowPass();
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::designLowPass()
+{
+	Dsp::Params params;
+	params[0] = double(designedSampleRate) / decimator.getRatio(); // sample rate
+	params[1] = 100; // cutoff frequency
+	params[2] = designedQFactor; // Q
+	lowPassFilter.setParams (params);
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::setDecimation(int ratio)
+{
+	if (ratio == decimator.getRatio())
+		return;
+
+	decimator.setup(ratio);
+	spectrogram.setDecimation(qMax(1, SpectrumDecimation / ratio));
+	if (designedSampleRate > 0)
+	{
+		// the old filter state belongs to the old rate; start clean
+		designLowPass();
+		lowPassFilter.reset();
+	}
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::setCarrier(double hz)
+{
+	carrier = hz;
+	if (designedSampleRate > 0)
+		demodulator.setParams(designedSampleRate, carrier, DemodCutoff, DemodDecimation);
+}
+
+template <typename Sample>
+int BasicDspPipeline<Sample>::process()
+{
+	// denormals flush to zero in hardware while the stages run, so the
+	// filters leave out their anti-denormal constant
+	Dsp::ScopedFlushToZero flushToZero;
+
+	// the ingest thread pushes ring_ra after ring_T, so ring_ra decides
+	// how much of the stream is complete
+	const quint64 end = qMin(in_T.written(), in_ra.written());
+
+	// If we fell so far behind that the ingest thread may be overwriting
+	// what we are about to read, drop the backlog. The input stages skip
+	// together so out_T and out_ra stay aligned for the mix stage.
+	const quint64 limit = quint64(in_T.capacity() / 2);
+	if (end - inputNext > limit)
+		skipInput(end - limit);
+
+	const quint64 before = out_ra.written();
+	while (inputNext < end)
+	{
+		const int count = int(qMin<quint64>(BlockSize, end - inputNext));
+		if (!readInput(count))
+		{
+			// overtaken while copying: drop the block and whatever the
+			// ingest thread is about to overwrite next
+			const quint64 written = qMin(in_T.written(), in_ra.written());
+			const quint64 resume = written > limit ? written - limit : 0;
+			skipInput(qMin(end, qMax(resume, inputNext + count)));
+			continue;
+		}
+
+		scaleStage(count);
+		demodStage(count);
+		highPassStage(count);
+		inputNext += count;
+	}
+	mixStage();
+	spectrumStage();
+	return int(out_ra.written() - before);
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::skipInput(quint64 to)
+{
+	skipped += to - inputNext;
+	inputNext = to;
+}
+
+// Copies count samples of T into block_a and of ra into block_b, from
+// inputNext on; false if the ingest thread overwrote any of them meanwhile.
+template <typename Sample>
+bool BasicDspPipeline<Sample>::readInput(int count)
+{
+	const typename SampleRing<Sample>::View T = in_T.range(inputNext, count);
+	const typename SampleRing<Sample>::View ra = in_ra.range(inputNext, count);
+	T.copyTo(block_a.data());
+	ra.copyTo(block_b.data());
+	return in_T.isIntact(T) && in_ra.isIntact(ra);
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::scaleStage(int count)
+{
+	Sample *T = block_a.data();
+	for (int i = 0; i < count; ++i)
+		T[i] *= Sample(0.1);
+
+	out_T.push(T, count);
+}
+
+// Filters ra in place, so it runs after the demod stage.
+template <typename Sample>
+void BasicDspPipeline<Sample>::highPassStage(int count)
+{
+	if (highPass)
+	{
+		Sample *channels[1] = { block_b.data() };
+		highPassFilter.process (count, channels);
+	}
+
+	out_ra.push(block_b.constData(), count);
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::mixStage()
+{
+	// the input stages have run, so both of our inputs end at the same index
+	const quint64 end = qMin(out_T.written(), out_ra.written());
+
+	while (mixNext < end)
+	{
+		const int count = int(qMin<quint64>(BlockSize, end - mixNext));
+		out_T.range(mixNext, count).copyTo(block_a.data());
+		out_ra.range(mixNext, count).copyTo(block_b.data());
+
+		Sample *rb = block_a.data();
+		const Sample *ra = block_b.constData();
+		for (int i = 0; i < count; ++i)
+			rb[i] = rb[i] * ra[i] / 500;
+
+		Sample *channels[1] = { rb };
+		const int kept = decimator.process (count, channels);
+
+		if (lowPass)
+			lowPassFilter.process (kept, channels);
+
+		out_rb.push(rb, kept);
+		mixNext += count;
+	}
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::spectrumStage()
+{
+	const quint64 end = out_rb.written();
+
+	while (spectrumNext < end)
+	{
+		const int count = int(qMin<quint64>(BlockSize, end - spectrumNext));
+		out_rb.range(spectrumNext, count).copyTo(block_a.data());
+
+		spectrogram.process(block_a.constData(), count, out_spectrum);
+		spectrumNext += count;
+	}
+}
+
+template <typename Sample>
+void BasicDspPipeline<Sample>::demodStage(int count)
+{
+	demodulator.process(block_b.constData(), count, out_I, out_Q);
+}
+
+template class BasicDspPipeline<float>;
+template class BasicDspPipeline<double>;
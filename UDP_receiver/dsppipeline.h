@@ -0,0 +1,142 @@
+#ifndef DSPPIPELINE_H
+#define DSPPIPELINE_H
+
+#include <QVector>
+#include "samplering.h"
+#include "spectrogram.h"
+#include "iqdemodulator.h"
+#include "DspFilters/Dsp.h"
+
+/*
+ * Streaming form of the mixing chain the plot shows:
+ *
+ *    T  -- x 0.1 -----------------------------------> out_T
+ *    ra -- high-pass -------------------------------> out_ra
+ *          out_T * out_ra / 500 -- / R -- low-pass --> out_rb
+ *          out_rb -- short-time FFT -----------------> out_spectrum
+ *    ra -- x carrier NCO -- low-pass / 16 ----------> out_I, out_Q
+ *
+ * The mixed signal of interest is a few hundred Hz wide, so before the
+ * low-pass it is decimated by R = decimation() (see Dsp::Decimator) and
+ * out_rb runs at 1/R of the input rate; the low-pass is designed for that
+ * rate. out_spectrum holds one Spectrogram column of spectrumBins() values
+ * per SpectrumHop * SpectrumDecimation input samples. out_I and out_Q are
+ * the complex baseband of ra around the transmit frequency (see
+ * IqDemodulator), one sample per DemodDecimation input samples.
+ *
+ * Every stage remembers the absolute index of the next input sample it has
+ * not consumed; the three stages reading T and ra take the same blocks and
+ * share one. process() runs each stage over whatever was appended to its
+ * input rings since the previous call, in blocks of BlockSize, and appends
+ * the results to the stage's own output ring. The cost of a call therefore
+ * follows the incoming sample rate, not the length of the plotted window,
+ * and the filter state carries over from call to call.
+ *
+ * A block of the input rings the ingest thread overwrote while it was
+ * being copied is dropped and counted in skippedSamples(), along with the
+ * rest of the backlog up to half a ring behind the ingest thread.
+ *
+ * process() and the setters must be called from one thread, which becomes
+ * the producer of the output rings; the output rings can be read from any
+ * thread.
+ *
+ * Sample is the type of all the rings and blocks, float or double; the
+ * receiver uses DspPipeline, the one for DspSample. The filters take either
+ * and keep their state in double, so the two differ only by the rounding
+ * of the stored samples; --bench compares the two.
+ */
+template <typename Sample>
+class BasicDspPipeline
+{
+public:
+	enum { BlockSize = 4096 };
+	// 256 point frames of the mixed signal decimated by 64 in all (out_rb
+	// is averaged down by the rest of the factor), a new one every 64
+	// decimated samples: about 6 Hz resolution and 24 columns a second
+	// at 100 kS/s
+	enum { SpectrumSize = 256, SpectrumHop = 64, SpectrumDecimation = 64 };
+	// out_rb rate: the mixed signal is decimated by a power of two up to
+	// MaxDecimation, by default to 6.25 kS/s for a 100 kS/s stream
+	enum { DefaultDecimation = 16, MaxDecimation = SpectrumDecimation };
+	// I/Q baseband bandwidth and output rate: +-1 kHz of Doppler at
+	// 6.25 kS/s for a 100 kS/s stream
+	enum { DemodCutoff = 1000, DemodDecimation = 16 };
+
+	BasicDspPipeline(SampleRing<Sample> &T, SampleRing<Sample> &ra);
+
+	// Redesigns the filters if either value changed. The filters glide to
+	// the new design over 1024 samples instead of restarting, redesigned
+	// every 32 samples with the coefficients interpolated in between.
+	void setParams(int sampleRate, double QFactor);
+	// Transmit frequency the I/Q demodulator mixes ra down from.
+	void setCarrier(double carrier);
+	// Decimation of the mixed signal ahead of the low-pass, a power of two
+	// up to MaxDecimation. Changing it restarts the decimator and redesigns
+	// the low-pass for the new rate.
+	void setDecimation(int ratio);
+	int decimation() const { return decimator.getRatio(); }
+	void setHighPass(bool on) { highPass = on; }
+	void setLowPass(bool on) { lowPass = on; }
+
+	// Consumes everything new on the input rings; returns the number of
+	// samples appended to out_T and out_ra.
+	int process();
+
+	SampleRing<Sample> out_T;
+	SampleRing<Sample> out_ra;
+	SampleRing<Sample> out_rb;
+	SampleRing<Sample> out_spectrum;
+	SampleRing<Sample> out_I;
+	SampleRing<Sample> out_Q;
+
+	int spectrumBins() const { return spectrogram.binCount(); }
+	// frequency of a spectrum bin for the given input sample rate
+	double spectrumFrequency(int bin, double sampleRate) const { return spectrogram.binFrequency(bin, sampleRate / decimation()); }
+
+	// input samples skipped because process() fell too far behind
+	quint64 skippedSamples() const { return skipped; }
+
+private:
+	BasicDspPipeline(const BasicDspPipeline &);
+	BasicDspPipeline &operator=(const BasicDspPipeline &);
+
+	void skipInput(quint64 to);
+	bool readInput(int count);
+	void scaleStage(int count);
+	void highPassStage(int count);
+	void designLowPass();
+	void mixStage();
+	void spectrumStage();
+	void demodStage(int count);
+
+	SampleRing<Sample> &in_T;
+	SampleRing<Sample> &in_ra;
+
+	// single channels at the full and the decimated rate: the block state
+	// computes several samples per step instead of one
+	Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::HighPass, 1, Dsp::BlockDirectFormII> highPassFilter;
+	Dsp::Decimator<1> decimator;
+	Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::LowPass, 1, Dsp::BlockDirectFormII> lowPassFilter;
+	Spectrogram spectrogram;
+	IqDemodulator demodulator;
+	int designedSampleRate;
+	double designedQFactor;
+	double carrier;
+	bool highPass;
+	bool lowPass;
+
+	// next input sample of each stage; the scale, high-pass and demod
+	// stages share inputNext
+	quint64 inputNext;
+	quint64 mixNext;
+	quint64 spectrumNext;
+	quint64 skipped;
+
+	// block_a holds T and block_b ra while the input stages run
+	QVector<Sample> block_a;
+	QVector<Sample> block_b;
+};
+
+typedef BasicDspPipeline<DspSample> DspPipeline;
+
+#endif
@@ -0,0 +1,114 @@
+#include <QElapsedTimer>
+
+#include "dspthread.h"
+
+DspThread::DspThread(SampleRing<DspSample> &T, SampleRing<DspSample> &ra)
+	: m_pipeline(T, ra)
+	, m_stop(false)
+	, m_carrier(40000)
+	, m_decimation(DspPipeline::DefaultDecimation)
+	, m_highPass(true)
+	, m_lowPass(true)
+	, m_skipped(0)
+	, m_publishedEnd(0)
+	, m_back(0)
+	, m_middle(1)
+	, m_front(2)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		m_frames[i].end = 0;
+		m_frames[i].rbEnd = 0;
+		m_frames[i].spectrumEnd = 0;
+		m_frames[i].demodEnd = 0;
+		m_frames[i].dspMs = 0;
+	}
+	m_params.sampleRate = 0;
+	m_params.QFactor = 0;
+}
+
+DspThread::~DspThread()
+{
+	stop();
+	wait();
+}
+
+void DspThread::stop()
+{
+	m_stop.store(true);
+}
+
+void DspThread::setParams(int sampleRate, double QFactor)
+{
+	QMutexLocker locker(&m_paramsLock);
+	m_params.sampleRate = sampleRate;
+	m_params.QFactor = QFactor;
+}
+
+const DspFrame *DspThread::takeFrame()
+{
+	if (!(m_middle.load(std::memory_order_relaxed) & Fresh))
+		return 0;
+
+	// hand our old front frame back as the middle one and take the newest
+	m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & ~Fresh;
+	return &m_frames[m_front];
+}
+
+void DspThread::compose()
+{
+	DspFrame &frame = m_frames[m_back];
+
+	frame.end = m_pipeline.out_ra.written();
+	frame.rbEnd = m_pipeline.out_rb.written();
+	frame.spectrumEnd = m_pipeline.out_spectrum.written() / m_pipeline.spectrumBins();
+	frame.demodEnd = m_pipeline.out_Q.written();
+	m_publishedEnd = frame.end;
+}
+
+void DspThread::publish()
+{
+	m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & ~Fresh;
+}
+
+void DspThread::run()
+{
+	QElapsedTimer busy;
+	qint64 busyNs = 0;
+
+	while (!m_stop.load(std::memory_order_relaxed))
+	{
+		busy.start();
+
+		// one consistent copy per block, never a new rate with an old Q
+		m_paramsLock.lock();
+		const Params params = m_params;
+		m_paramsLock.unlock();
+
+		m_pipeline.setParams(params.sampleRate, params.QFactor);
+		m_pipeline.setCarrier(m_carrier.load());
+		m_pipeline.setDecimation(m_decimation.load());
+		m_pipeline.setHighPass(m_highPass.load());
+		m_pipeline.setLowPass(m_lowPass.load());
+		const int count = m_pipeline.process();
+		m_skipped.store(m_pipeline.skippedSamples(), std::memory_order_relaxed);
+
+		// compose a new frame only once the GUI took the last one
+		const bool wanted = !(m_middle.load(std::memory_order_relaxed) & Fresh);
+		if (wanted && m_pipeline.out_ra.written() != m_publishedEnd)
+		{
+			compose();
+			m_frames[m_back].dspMs = (busyNs + busy.nsecsElapsed()) / 1e6;
+			publish();
+			busyNs = 0;
+		}
+		else
+		{
+			busyNs += busy.nsecsElapsed();
+		}
+
+		// nothing new arrived: don't spin
+		if (count == 0)
+			msleep(2);
+	}
+}
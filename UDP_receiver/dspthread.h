@@ -0,0 +1,104 @@
+#ifndef DSPTHREAD_H
+#define DSPTHREAD_H
+
+#include <QMutex>
+#include <QThread>
+#include <atomic>
+#include "dsppipeline.h"
+
+// One finished step of the mixing chain, ready to be plotted. The samples
+// stay in the pipeline's output rings; out_T and out_ra are complete up to
+// end, the decimated out_rb up to rbEnd.
+struct DspFrame
+{
+	quint64 end;		// index in out_T and out_ra of the sample after the last one
+	quint64 rbEnd;		// samples complete in out_rb
+	quint64 spectrumEnd;	// spectrum columns complete in out_spectrum
+	quint64 demodEnd;		// samples complete in out_I and out_Q
+	double dspMs;		// worker time spent on this frame, filtering since the last frame
+};
+
+/*
+ * Runs the DspPipeline on its own thread so that filtering never holds up
+ * the GUI, and hands finished frames to the GUI through a triple buffer:
+ * the worker fills the back frame while the GUI plots the front frame, and
+ * the two swap through the middle slot without locks or copies. A frame is
+ * composed only after the GUI took the previous one.
+ *
+ * The GUI plots straight out of the output rings (see RingPlotSource). The
+ * worker never waits for the GUI, so a stalled reader can be overtaken:
+ * readers keep their distance from the write position and check with
+ * SampleRing::isIntact() after reading, dropping what was overwritten.
+ *
+ * The setters can be called from any thread; they take effect on the
+ * worker before its next block.
+ */
+class DspThread : public QThread
+{
+public:
+	DspThread(SampleRing<DspSample> &T, SampleRing<DspSample> &ra);
+	~DspThread();
+
+	void stop();
+
+	void setParams(int sampleRate, double QFactor);
+	void setCarrier(double carrier) { m_carrier.store(carrier); }
+	// see DspPipeline::setDecimation()
+	void setDecimation(int ratio) { m_decimation.store(ratio); }
+	void setHighPass(bool on) { m_highPass.store(on); }
+	void setLowPass(bool on) { m_lowPass.store(on); }
+
+	// GUI side: the newest finished frame, or 0 if there is none since the
+	// last call. The frame stays valid until the next call.
+	const DspFrame *takeFrame();
+
+	// see DspPipeline::skippedSamples(); shown in the status bar
+	quint64 skippedSamples() const { return m_skipped.load(std::memory_order_relaxed); }
+
+	// Output rings of the pipeline, for plotting up to a frame's end.
+	const SampleRing<DspSample> &outT() const { return m_pipeline.out_T; }
+	const SampleRing<DspSample> &outRa() const { return m_pipeline.out_ra; }
+	// Decimated by the ratio last passed to setDecimation().
+	const SampleRing<DspSample> &outRb() const { return m_pipeline.out_rb; }
+	// Spectrogram of out_rb, spectrumBins() values per column.
+	const SampleRing<DspSample> &outSpectrum() const { return m_pipeline.out_spectrum; }
+	int spectrumBins() const { return m_pipeline.spectrumBins(); }
+	double spectrumFrequency(int bin, double sampleRate) const { return m_pipeline.spectrumFrequency(bin, sampleRate); }
+	// Complex baseband of ra, DspPipeline::DemodDecimation input samples per sample.
+	const SampleRing<DspSample> &outI() const { return m_pipeline.out_I; }
+	const SampleRing<DspSample> &outQ() const { return m_pipeline.out_Q; }
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	enum { Fresh = 4 };		// flag on m_middle: the middle frame has not been taken yet
+
+	// the filter design depends on both, so they change together
+	struct Params
+	{
+		int sampleRate;
+		double QFactor;
+	};
+
+	void compose();
+	void publish();
+
+	DspPipeline m_pipeline;
+	std::atomic<bool> m_stop;
+	QMutex m_paramsLock;
+	Params m_params;			// guarded by m_paramsLock
+	std::atomic<double> m_carrier;
+	std::atomic<int> m_decimation;
+	std::atomic<bool> m_highPass;
+	std::atomic<bool> m_lowPass;
+	std::atomic<quint64> m_skipped;
+
+	DspFrame m_frames[3];
+	quint64 m_publishedEnd;		// worker only
+	int m_back;					// worker only
+	std::atomic<int> m_middle;	// frame index | Fresh
+	int m_front;				// GUI only
+};
+
+#endif
@@ -0,0 +1,482 @@
+#include <cstring>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVarLengthArray>
+#include <qmath.h>
+
+#include "fft.h"
+
+/*
+ * Every stage is one pass of a self-sorting (Stockham) decimation in
+ * frequency. A stage of radix R over a remaining length of R * m, with
+ * stride s (the product of the earlier radices), computes for p < m, q < s
+ *
+ *    a_k = x[q + s * (p + k * m)]                       k = 0 .. R-1
+ *    y[q + s * (R * p + j)] = DFT_R(a)_j * w^(j * p)    j = 0 .. R-1
+ *
+ * with w = exp(-2 pi i / (R * m)). The q loop is contiguous in memory and
+ * shares its twiddles, so it is the inner loop whenever s > 1. In the first
+ * stage s is 1 and the p loop runs inside instead, reading contiguously and
+ * writing with the constant stride R.
+ */
+
+const FftPlan &FftPlan::get(int size)
+{
+	static QMutex mutex;
+	static QHash<int, FftPlan *> plans;
+
+	QMutexLocker locker(&mutex);
+	FftPlan *&plan = plans[size];
+	if (!plan)
+		plan = new FftPlan(size);
+	return *plan;
+}
+
+FftPlan::FftPlan(int size)
+	: m_size(size)
+{
+	int remaining = size;
+	int stride = 1;
+	while (remaining > 1)
+	{
+		int radix;
+		if (remaining % 4 == 0)
+			radix = 4;
+		else if (remaining % 2 == 0)
+			radix = 2;
+		else if (remaining % 3 == 0)
+			radix = 3;
+		else if (remaining % 5 == 0)
+			radix = 5;
+		else
+		{
+			radix = 7;
+			while (remaining % radix != 0)
+				radix += 2;
+		}
+
+		Stage stage;
+		stage.radix = radix;
+		stage.m = remaining / radix;
+		stage.stride = stride;
+		stage.twiddleRe.resize((radix - 1) * stage.m);
+		stage.twiddleIm.resize((radix - 1) * stage.m);
+		for (int j = 1; j < radix; ++j)
+		{
+			for (int p = 0; p < stage.m; ++p)
+			{
+				// reduce the exponent first so large sizes keep full precision
+				const double angle = -2 * M_PI * double((qint64(j) * p) % remaining) / remaining;
+				stage.twiddleRe[(j - 1) * stage.m + p] = qCos(angle);
+				stage.twiddleIm[(j - 1) * stage.m + p] = qSin(angle);
+			}
+		}
+		if (radix > 5)
+		{
+			stage.rootRe.resize(radix);
+			stage.rootIm.resize(radix);
+			for (int k = 0; k < radix; ++k)
+			{
+				stage.rootRe[k] = qCos(-2 * M_PI * k / radix);
+				stage.rootIm[k] = qSin(-2 * M_PI * k / radix);
+			}
+		}
+		m_stages.append(stage);
+
+		remaining /= radix;
+		stride *= radix;
+	}
+
+	m_realTwiddleRe.resize(size / 2 + 1);
+	m_realTwiddleIm.resize(size / 2 + 1);
+	for (int k = 0; k <= size / 2; ++k)
+	{
+		m_realTwiddleRe[k] = qCos(-2 * M_PI * k / size);
+		m_realTwiddleIm[k] = qSin(-2 * M_PI * k / size);
+	}
+}
+
+void FftPlan::transform(double *re, double *im, double *workRe, double *workIm) const
+{
+	const double *xr = re;
+	const double *xi = im;
+	double *yr = workRe;
+	double *yi = workIm;
+
+	for (int i = 0; i < m_stages.size(); ++i)
+	{
+		const Stage &stage = m_stages.at(i);
+		switch (stage.radix)
+		{
+		case 2: radix2(stage, xr, xi, yr, yi); break;
+		case 3: radix3(stage, xr, xi, yr, yi); break;
+		case 4: radix4(stage, xr, xi, yr, yi); break;
+		case 5: radix5(stage, xr, xi, yr, yi); break;
+		default: radixGeneric(stage, xr, xi, yr, yi); break;
+		}
+
+		// the output of this stage is the input of the next one
+		double *nextRe = const_cast<double *>(xr);
+		double *nextIm = const_cast<double *>(xi);
+		xr = yr;
+		xi = yi;
+		yr = nextRe;
+		yi = nextIm;
+	}
+
+	if (xr != re)
+	{
+		memcpy(re, xr, m_size * sizeof(double));
+		memcpy(im, xi, m_size * sizeof(double));
+	}
+}
+
+// The butterflies below read their R inputs at x + k * xs and write their
+// R outputs at y + j * ys, k, j = 0 .. R-1.
+
+static inline void butterfly2(const double *xr, const double *xi, int xs,
+	double *yr, double *yi, int ys, double w1r, double w1i)
+{
+	const double ar = xr[0], ai = xi[0];
+	const double br = xr[xs], bi = xi[xs];
+	const double dr = ar - br, di = ai - bi;
+	yr[0] = ar + br;
+	yi[0] = ai + bi;
+	yr[ys] = dr * w1r - di * w1i;
+	yi[ys] = dr * w1i + di * w1r;
+}
+
+void FftPlan::radix2(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi)
+{
+	const int m = stage.m;
+	const int s = stage.stride;
+	const double *w1r = stage.twiddleRe.constData();
+	const double *w1i = stage.twiddleIm.constData();
+
+	if (s == 1)
+	{
+		for (int p = 0; p < m; ++p)
+			butterfly2(xr + p, xi + p, m, yr + 2 * p, yi + 2 * p, 1, w1r[p], w1i[p]);
+		return;
+	}
+	for (int p = 0; p < m; ++p)
+	{
+		const double t1r = w1r[p], t1i = w1i[p];
+		const double *ar = xr + s * p, *ai = xi + s * p;
+		double *br = yr + s * 2 * p, *bi = yi + s * 2 * p;
+		for (int q = 0; q < s; ++q)
+			butterfly2(ar + q, ai + q, s * m, br + q, bi + q, s, t1r, t1i);
+	}
+}
+
+static inline void butterfly3(const double *xr, const double *xi, int xs,
+	double *yr, double *yi, int ys,
+	double w1r, double w1i, double w2r, double w2i)
+{
+	const double sin60 = 0.86602540378443864676;
+	const double a0r = xr[0], a0i = xi[0];
+	const double a1r = xr[xs], a1i = xi[xs];
+	const double a2r = xr[2 * xs], a2i = xi[2 * xs];
+
+	const double tr = a1r + a2r, ti = a1i + a2i;
+	const double ur = a0r - 0.5 * tr, ui = a0i - 0.5 * ti;
+	// -i * sin60 * (a1 - a2)
+	const double vr = sin60 * (a1i - a2i), vi = -sin60 * (a1r - a2r);
+
+	const double c1r = ur + vr, c1i = ui + vi;
+	const double c2r = ur - vr, c2i = ui - vi;
+	yr[0] = a0r + tr;
+	yi[0] = a0i + ti;
+	yr[ys] = c1r * w1r - c1i * w1i;
+	yi[ys] = c1r * w1i + c1i * w1r;
+	yr[2 * ys] = c2r * w2r - c2i * w2i;
+	yi[2 * ys] = c2r * w2i + c2i * w2r;
+}
+
+void FftPlan::radix3(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi)
+{
+	const int m = stage.m;
+	const int s = stage.stride;
+	const double *w1r = stage.twiddleRe.constData(), *w1i = stage.twiddleIm.constData();
+	const double *w2r = w1r + m, *w2i = w1i + m;
+
+	if (s == 1)
+	{
+		for (int p = 0; p < m; ++p)
+			butterfly3(xr + p, xi + p, m, yr + 3 * p, yi + 3 * p, 1, w1r[p], w1i[p], w2r[p], w2i[p]);
+		return;
+	}
+	for (int p = 0; p < m; ++p)
+	{
+		const double t1r = w1r[p], t1i = w1i[p], t2r = w2r[p], t2i = w2i[p];
+		const double *ar = xr + s * p, *ai = xi + s * p;
+		double *br = yr + s * 3 * p, *bi = yi + s * 3 * p;
+		for (int q = 0; q < s; ++q)
+			butterfly3(ar + q, ai + q, s * m, br + q, bi + q, s, t1r, t1i, t2r, t2i);
+	}
+}
+
+static inline void butterfly4(const double *xr, const double *xi, int xs,
+	double *yr, double *yi, int ys,
+	double w1r, double w1i, double w2r, double w2i, double w3r, double w3i)
+{
+	const double a0r = xr[0], a0i = xi[0];
+	const double a1r = xr[xs], a1i = xi[xs];
+	const double a2r = xr[2 * xs], a2i = xi[2 * xs];
+	const double a3r = xr[3 * xs], a3i = xi[3 * xs];
+
+	const double t0r = a0r + a2r, t0i = a0i + a2i;
+	const double t1r = a0r - a2r, t1i = a0i - a2i;
+	const double t2r = a1r + a3r, t2i = a1i + a3i;
+	// -i * (a1 - a3)
+	const double t3r = a1i - a3i, t3i = a3r - a1r;
+
+	const double c1r = t1r + t3r, c1i = t1i + t3i;
+	const double c2r = t0r - t2r, c2i = t0i - t2i;
+	const double c3r = t1r - t3r, c3i = t1i - t3i;
+	yr[0] = t0r + t2r;
+	yi[0] = t0i + t2i;
+	yr[ys] = c1r * w1r - c1i * w1i;
+	yi[ys] = c1r * w1i + c1i * w1r;
+	yr[2 * ys] = c2r * w2r - c2i * w2i;
+	yi[2 * ys] = c2r * w2i + c2i * w2r;
+	yr[3 * ys] = c3r * w3r - c3i * w3i;
+	yi[3 * ys] = c3r * w3i + c3i * w3r;
+}
+
+void FftPlan::radix4(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi)
+{
+	const int m = stage.m;
+	const int s = stage.stride;
+	const double *w1r = stage.twiddleRe.constData(), *w1i = stage.twiddleIm.constData();
+	const double *w2r = w1r + m, *w2i = w1i + m;
+	const double *w3r = w2r + m, *w3i = w2i + m;
+
+	if (s == 1)
+	{
+		for (int p = 0; p < m; ++p)
+			butterfly4(xr + p, xi + p, m, yr + 4 * p, yi + 4 * p, 1,
+				w1r[p], w1i[p], w2r[p], w2i[p], w3r[p], w3i[p]);
+		return;
+	}
+	for (int p = 0; p < m; ++p)
+	{
+		const double t1r = w1r[p], t1i = w1i[p], t2r = w2r[p], t2i = w2i[p], t3r = w3r[p], t3i = w3i[p];
+		const double *ar = xr + s * p, *ai = xi + s * p;
+		double *br = yr + s * 4 * p, *bi = yi + s * 4 * p;
+		for (int q = 0; q < s; ++q)
+			butterfly4(ar + q, ai + q, s * m, br + q, bi + q, s, t1r, t1i, t2r, t2i, t3r, t3i);
+	}
+}
+
+static inline void butterfly5(const double *xr, const double *xi, int xs,
+	double *yr, double *yi, int ys, const double *wr, const double *wi, int ws)
+{
+	const double c1 = 0.30901699437494742410;	// cos(2 pi / 5)
+	const double c2 = -0.80901699437494742410;	// cos(4 pi / 5)
+	const double s1 = 0.95105651629515357212;	// sin(2 pi / 5)
+	const double s2 = 0.58778525229247312917;	// sin(4 pi / 5)
+
+	const double a0r = xr[0], a0i = xi[0];
+	const double b1r = xr[xs] + xr[4 * xs], b1i = xi[xs] + xi[4 * xs];
+	const double b2r = xr[2 * xs] + xr[3 * xs], b2i = xi[2 * xs] + xi[3 * xs];
+	const double d1r = xr[xs] - xr[4 * xs], d1i = xi[xs] - xi[4 * xs];
+	const double d2r = xr[2 * xs] - xr[3 * xs], d2i = xi[2 * xs] - xi[3 * xs];
+
+	const double r1r = a0r + c1 * b1r + c2 * b2r, r1i = a0i + c1 * b1i + c2 * b2i;
+	const double r2r = a0r + c2 * b1r + c1 * b2r, r2i = a0i + c2 * b1i + c1 * b2i;
+	// -i * (s1 * d1 + s2 * d2) and -i * (s2 * d1 - s1 * d2)
+	const double i1r = s1 * d1i + s2 * d2i, i1i = -(s1 * d1r + s2 * d2r);
+	const double i2r = s2 * d1i - s1 * d2i, i2i = -(s2 * d1r - s1 * d2r);
+
+	const double cr[4] = { r1r + i1r, r2r + i2r, r2r - i2r, r1r - i1r };
+	const double ci[4] = { r1i + i1i, r2i + i2i, r2i - i2i, r1i - i1i };
+	yr[0] = a0r + b1r + b2r;
+	yi[0] = a0i + b1i + b2i;
+	for (int j = 0; j < 4; ++j)
+	{
+		const double tr = wr[j * ws], ti = wi[j * ws];
+		yr[(j + 1) * ys] = cr[j] * tr - ci[j] * ti;
+		yi[(j + 1) * ys] = cr[j] * ti + ci[j] * tr;
+	}
+}
+
+void FftPlan::radix5(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi)
+{
+	const int m = stage.m;
+	const int s = stage.stride;
+	const double *wr = stage.twiddleRe.constData();
+	const double *wi = stage.twiddleIm.constData();
+
+	for (int p = 0; p < m; ++p)
+	{
+		const double *ar = xr + s * p, *ai = xi + s * p;
+		double *br = yr + s * 5 * p, *bi = yi + s * 5 * p;
+		for (int q = 0; q < s; ++q)
+			butterfly5(ar + q, ai + q, s * m, br + q, bi + q, s, wr + p, wi + p, m);
+	}
+}
+
+void FftPlan::radixGeneric(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi)
+{
+	const int radix = stage.radix;
+	const int m = stage.m;
+	const int s = stage.stride;
+	const double *wr = stage.twiddleRe.constData();
+	const double *wi = stage.twiddleIm.constData();
+	const double *rootRe = stage.rootRe.constData();
+	const double *rootIm = stage.rootIm.constData();
+	QVarLengthArray<double, 64> ar(radix), ai(radix);
+
+	for (int p = 0; p < m; ++p)
+	{
+		for (int q = 0; q < s; ++q)
+		{
+			for (int k = 0; k < radix; ++k)
+			{
+				ar[k] = xr[q + s * (p + k * m)];
+				ai[k] = xi[q + s * (p + k * m)];
+			}
+			for (int j = 0; j < radix; ++j)
+			{
+				double sumRe = 0, sumIm = 0;
+				for (int k = 0, jk = 0; k < radix; ++k, jk = (jk + j) % radix)
+				{
+					sumRe += ar[k] * rootRe[jk] - ai[k] * rootIm[jk];
+					sumIm += ar[k] * rootIm[jk] + ai[k] * rootRe[jk];
+				}
+				double tr = 1, ti = 0;
+				if (j > 0)
+				{
+					tr = wr[(j - 1) * m + p];
+					ti = wi[(j - 1) * m + p];
+				}
+				yr[q + s * (radix * p + j)] = sumRe * tr - sumIm * ti;
+				yi[q + s * (radix * p + j)] = sumRe * ti + sumIm * tr;
+			}
+		}
+	}
+}
+
+Fft::Fft(int size)
+	: m_size(size)
+	, m_plan(FftPlan::get(size))
+	, m_halfPlan(size % 2 == 0 ? &FftPlan::get(size / 2) : 0)
+	, m_re(size)
+	, m_im(size)
+	, m_workRe(size)
+	, m_workIm(size)
+{
+}
+
+void Fft::forward(const double *inRe, const double *inIm, double *outRe, double *outIm)
+{
+	if (outRe != inRe)
+		memcpy(outRe, inRe, m_size * sizeof(double));
+	if (outIm != inIm)
+		memcpy(outIm, inIm, m_size * sizeof(double));
+	m_plan.transform(outRe, outIm, m_workRe.data(), m_workIm.data());
+}
+
+void Fft::inverse(const double *inRe, const double *inIm, double *outRe, double *outIm)
+{
+	// conj(forward(conj(x)))
+	if (outRe != inRe)
+		memcpy(outRe, inRe, m_size * sizeof(double));
+	for (int i = 0; i < m_size; ++i)
+		outIm[i] = -inIm[i];
+	m_plan.transform(outRe, outIm, m_workRe.data(), m_workIm.data());
+	for (int i = 0; i < m_size; ++i)
+		outIm[i] = -outIm[i];
+}
+
+void Fft::forwardReal(const double *in, double *outRe, double *outIm)
+{
+	double *re = m_re.data();
+	double *im = m_im.data();
+
+	if (!m_halfPlan)
+	{
+		// odd size: full complex transform of the real signal
+		memcpy(re, in, m_size * sizeof(double));
+		memset(im, 0, m_size * sizeof(double));
+		m_plan.transform(re, im, m_workRe.data(), m_workIm.data());
+		memcpy(outRe, re, realBins() * sizeof(double));
+		memcpy(outIm, im, realBins() * sizeof(double));
+		return;
+	}
+
+	// pack even samples into the real and odd samples into the imaginary
+	// part of a half-size signal z, so Z = E + iO for the transforms E and O
+	// of the even and odd samples
+	const int half = m_size / 2;
+	for (int k = 0; k < half; ++k)
+	{
+		re[k] = in[2 * k];
+		im[k] = in[2 * k + 1];
+	}
+	m_halfPlan->transform(re, im, m_workRe.data(), m_workIm.data());
+
+	// X[k] = E[k] + w^k O[k], with E[k] = (Z[k] + conj(Z[h-k])) / 2 and
+	// O[k] = -i (Z[k] - conj(Z[h-k])) / 2
+	const double *wr = m_plan.realTwiddleRe();
+	const double *wi = m_plan.realTwiddleIm();
+	for (int k = 0; k <= half; ++k)
+	{
+		const int a = k < half ? k : 0;
+		const int b = k > 0 ? half - k : 0;
+		const double zr = re[a], zi = im[a];
+		const double cr = re[b], ci = -im[b];
+
+		const double er = 0.5 * (zr + cr), ei = 0.5 * (zi + ci);
+		const double or_ = 0.5 * (zi - ci), oi = -0.5 * (zr - cr);
+		outRe[k] = er + or_ * wr[k] - oi * wi[k];
+		outIm[k] = ei + or_ * wi[k] + oi * wr[k];
+	}
+}
+
+void Fft::inverseReal(const double *inRe, const double *inIm, double *out)
+{
+	double *re = m_re.data();
+	double *im = m_im.data();
+
+	if (!m_halfPlan)
+	{
+		// odd size: rebuild the conjugate mirror and transform back in full
+		const int bins = realBins();
+		for (int k = 0; k < m_size; ++k)
+		{
+			re[k] = k < bins ? inRe[k] : inRe[m_size - k];
+			im[k] = k < bins ? inIm[k] : -inIm[m_size - k];
+		}
+		inverse(re, im, re, im);
+		memcpy(out, re, m_size * sizeof(double));
+		return;
+	}
+
+	// undo forwardReal: Z'[k] = E'[k] + i O'[k] with E' = X[k] + conj(X[h-k])
+	// and O' = (X[k] - conj(X[h-k])) * conj(w^k); the half-size inverse of Z'
+	// then gives size() times the interleaved samples
+	const int half = m_size / 2;
+	const double *wr = m_plan.realTwiddleRe();
+	const double *wi = m_plan.realTwiddleIm();
+	for (int k = 0; k < half; ++k)
+	{
+		const double xr = inRe[k], xi = inIm[k];
+		const double cr = inRe[half - k], ci = -inIm[half - k];
+
+		const double er = xr + cr, ei = xi + ci;
+		const double dr = xr - cr, di = xi - ci;
+		const double or_ = dr * wr[k] + di * wi[k], oi = di * wr[k] - dr * wi[k];
+		// conj for the inverse via the forward plan: conj(E' + iO')
+		re[k] = er - oi;
+		im[k] = -(ei + or_);
+	}
+	m_halfPlan->transform(re, im, m_workRe.data(), m_workIm.data());
+	for (int k = 0; k < half; ++k)
+	{
+		out[2 * k] = re[k];
+		out[2 * k + 1] = -im[k];
+	}
+}
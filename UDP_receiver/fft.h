@@ -0,0 +1,106 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <QVector>
+
+/*
+ * Discrete Fourier transforms for the receiver's spectrum, spectrogram
+ * and correlation features.
+ *
+ * FftPlan holds everything about a transform that depends only on its
+ * size: the factorization into radix 4, 2, 3, 5 and generic odd stages,
+ * and the twiddle factors of every stage. Plans are built once per size
+ * and shared through FftPlan::get(), which any thread may call; a plan is
+ * never modified after it is built.
+ *
+ * Fft is what callers use. It takes the shared plans for its size and owns
+ * the work buffers, so every thread (or every pipeline stage) should have
+ * its own Fft object.
+ *
+ * Data are passed as split real and imaginary arrays. The stages are
+ * self-sorting (Stockham), so there is no bit-reversal pass, and their
+ * inner loops run over contiguous arrays of doubles, which the compiler
+ * turns into SIMD code for whatever the target supports.
+ *
+ * Sizes with a large prime factor fall back to an O(p^2) stage for it;
+ * they work, but are best avoided where speed matters.
+ *
+ * Transforms are unnormalized: forward uses exp(-2 pi i jk / n), and
+ * inverse(forward(x)) yields size() * x.
+ */
+class FftPlan
+{
+public:
+	// The shared plan for size, built on first use.
+	static const FftPlan &get(int size);
+
+	int size() const { return m_size; }
+
+	// In-place forward transform of re/im; work must hold size() doubles each.
+	void transform(double *re, double *im, double *workRe, double *workIm) const;
+
+	// exp(-2 pi i k / size()) for k = 0 .. size() / 2, used to split the
+	// half-size transform of a real signal
+	const double *realTwiddleRe() const { return m_realTwiddleRe.constData(); }
+	const double *realTwiddleIm() const { return m_realTwiddleIm.constData(); }
+
+private:
+	struct Stage
+	{
+		int radix;
+		int m;			// sub-transforms per butterfly column (stage length / radix)
+		int stride;		// product of the radices of the earlier stages
+		QVector<double> twiddleRe;	// w^(j * p) for j = 1 .. radix-1, p = 0 .. m-1, j major
+		QVector<double> twiddleIm;
+		QVector<double> rootRe;		// exp(-2 pi i k / radix), generic radices only
+		QVector<double> rootIm;
+	};
+
+	explicit FftPlan(int size);
+	FftPlan(const FftPlan &);
+	FftPlan &operator=(const FftPlan &);
+
+	static void radix2(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi);
+	static void radix3(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi);
+	static void radix4(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi);
+	static void radix5(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi);
+	static void radixGeneric(const Stage &stage, const double *xr, const double *xi, double *yr, double *yi);
+
+	const int m_size;
+	QVector<Stage> m_stages;
+	QVector<double> m_realTwiddleRe;
+	QVector<double> m_realTwiddleIm;
+};
+
+class Fft
+{
+public:
+	explicit Fft(int size);
+
+	int size() const { return m_size; }
+	// bins of the real transforms: size() / 2 + 1
+	int realBins() const { return m_size / 2 + 1; }
+
+	// Complex transforms of size() points. The output may alias the input.
+	void forward(const double *inRe, const double *inIm, double *outRe, double *outIm);
+	void inverse(const double *inRe, const double *inIm, double *outRe, double *outIm);
+
+	// Transform of size() real samples into realBins() complex bins, the
+	// upper half of the spectrum being the conjugate mirror of the lower.
+	void forwardReal(const double *in, double *outRe, double *outIm);
+	// Inverse of forwardReal: realBins() bins into size() real samples.
+	void inverseReal(const double *inRe, const double *inIm, double *out);
+
+private:
+	const int m_size;
+	const FftPlan &m_plan;
+	// half-size plan for the real transforms of an even size, else 0
+	const FftPlan *m_halfPlan;
+
+	QVector<double> m_re;
+	QVector<double> m_im;
+	QVector<double> m_workRe;
+	QVector<double> m_workIm;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <QDebug>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ingestthread.h"
+#include "networkcontroller.h"
+
+IngestThread::IngestThread(NetworkController *controller, quint16 port)
+	: m_controller(controller)
+	, m_port(port)
+	, m_fd(-1)
+	, m_stop(false)
+	, m_received(0)
+	, m_dropped(0)
+{
+	m_arena = new char[BatchSize * MaxDatagramSize];
+
+	memset(m_msgs, 0, sizeof(m_msgs));
+	for (int i = 0; i < BatchSize; ++i)
+	{
+		m_iovecs[i].iov_base = m_arena + i * MaxDatagramSize;
+		m_iovecs[i].iov_len = MaxDatagramSize;
+		m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+		m_msgs[i].msg_hdr.msg_iovlen = 1;
+		m_msgs[i].msg_hdr.msg_control = m_control[i];
+	}
+}
+
+IngestThread::~IngestThread()
+{
+	stop();
+	wait();
+	delete[] m_arena;
+}
+
+void IngestThread::stop()
+{
+	m_stop.store(true);
+}
+
+bool IngestThread::openSocket()
+{
+	m_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (m_fd < 0)
+	{
+		qWarning() << "ingest: socket() failed:" << strerror(errno);
+		return false;
+	}
+
+	// a large receive buffer absorbs bursts while we are descheduled
+	int rcvbuf = 8 * 1024 * 1024;
+	setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	// ask the kernel to report how many datagrams it had to drop
+	int one = 1;
+	setsockopt(m_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(m_port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(m_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+	{
+		qWarning() << "ingest: bind() to port" << m_port << "failed:" << strerror(errno);
+		close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+void IngestThread::run()
+{
+	if (!openSocket())
+		return;
+
+	struct pollfd pfd;
+	pfd.fd = m_fd;
+	pfd.events = POLLIN;
+
+	while (!m_stop.load(std::memory_order_relaxed))
+	{
+		// wake up periodically so stop() is noticed on an idle stream
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+
+		for (int i = 0; i < BatchSize; ++i)
+			m_msgs[i].msg_hdr.msg_controllen = sizeof(m_control[i]);
+
+		int n = recvmmsg(m_fd, m_msgs, BatchSize, MSG_DONTWAIT, 0);
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				continue;
+			qWarning() << "ingest: recvmmsg() failed:" << strerror(errno);
+			break;
+		}
+
+		for (int i = 0; i < n; ++i)
+		{
+			struct msghdr *hdr = &m_msgs[i].msg_hdr;
+			for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg))
+			{
+				if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+				{
+					quint32 dropped;
+					memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+					m_dropped.store(dropped, std::memory_order_relaxed);
+				}
+			}
+
+			m_controller->processDatagram(m_arena + i * MaxDatagramSize, m_msgs[i].msg_len);
+		}
+		m_received.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	close(m_fd);
+	m_fd = -1;
+}
@@ -0,0 +1,52 @@
+#ifndef INGESTTHREAD_H
+#define INGESTTHREAD_H
+
+#include <QThread>
+#include <atomic>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+class NetworkController;
+
+/*
+ * Drains the scope's UDP stream on its own thread so that ingest never
+ * waits for redraw()/replot() on the GUI thread.
+ *
+ * Datagrams are read in batches with recvmmsg() into a pre-allocated arena
+ * and handed to NetworkController::processDatagram(), which pushes the
+ * samples into the lock-free rings the GUI reads from.
+ */
+class IngestThread : public QThread
+{
+public:
+	enum { BatchSize = 64, MaxDatagramSize = 65536 };
+
+	IngestThread(NetworkController *controller, quint16 port);
+	~IngestThread();
+
+	void stop();
+
+	quint64 datagramsReceived() const { return m_received.load(std::memory_order_relaxed); }
+	// datagrams the kernel discarded because the socket buffer was full
+	quint64 datagramsDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	bool openSocket();
+
+	NetworkController *m_controller;
+	quint16 m_port;
+	int m_fd;
+	std::atomic<bool> m_stop;
+	std::atomic<quint64> m_received;
+	std::atomic<quint64> m_dropped;
+
+	char *m_arena;
+	struct mmsghdr m_msgs[BatchSize];
+	struct iovec m_iovecs[BatchSize];
+	char m_control[BatchSize][CMSG_SPACE(sizeof(quint32))];
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <qmath.h>
+
+#include "iqdemodulator.h"
+
+IqDemodulator::IqDemodulator()
+	: m_sampleRate(0)
+	, m_carrier(0)
+	, m_cutoff(0)
+	, m_decimation(1)
+	, m_phaseRe(1)
+	, m_phaseIm(0)
+	, m_stepRe(BlockSize)
+	, m_stepIm(BlockSize)
+	, m_blockStepRe(1)
+	, m_blockStepIm(0)
+	, m_i(BlockSize)
+	, m_q(BlockSize)
+{
+	for (int k = 0; k < BlockSize; ++k)
+	{
+		m_stepRe[k] = 1;
+		m_stepIm[k] = 0;
+	}
+}
+
+void IqDemodulator::setParams(double sampleRate, double carrier, double cutoff, int decimation)
+{
+	if (sampleRate == m_sampleRate && carrier == m_carrier && cutoff == m_cutoff && decimation == m_decimation)
+		return;
+	if (sampleRate <= 0)
+		return;
+
+	const double w = 2 * M_PI * carrier / sampleRate;
+	for (int k = 0; k < BlockSize; ++k)
+	{
+		m_stepRe[k] = qCos(w * k);
+		m_stepIm[k] = -qSin(w * k);
+	}
+	m_blockStepRe = qCos(w * BlockSize);
+	m_blockStepIm = -qSin(w * BlockSize);
+
+	// the decimator is flat up to 0.4 of the output Nyquist frequency; keep
+	// the cutoff inside that
+	const int ratio = qMax(1, decimation);
+	if (ratio != m_decimator.getRatio())
+		m_decimator.setup(ratio);
+	const double outputRate = sampleRate / ratio;
+	m_lowPass.setup(4, outputRate, qMin(cutoff, 0.2 * outputRate));
+
+	m_sampleRate = sampleRate;
+	m_carrier = carrier;
+	m_cutoff = cutoff;
+	m_decimation = ratio;
+}
+
+template <typename Sample>
+void IqDemodulator::mix(const Sample *samples, int count, double *i, double *q)
+{
+	const double pr = 2 * m_phaseRe;
+	const double pi = 2 * m_phaseIm;
+	const double *sr = m_stepRe.constData();
+	const double *si = m_stepIm.constData();
+
+	for (int k = 0; k < count; ++k)
+	{
+		const double cr = pr * sr[k] - pi * si[k];
+		const double ci = pr * si[k] + pi * sr[k];
+		i[k] = samples[k] * cr;
+		q[k] = samples[k] * ci;
+	}
+
+	// advance the phasor by count samples: a full block by the block step,
+	// the last partial block of a call by the table entry for its length
+	const double stepRe = count < BlockSize ? sr[count] : m_blockStepRe;
+	const double stepIm = count < BlockSize ? si[count] : m_blockStepIm;
+	const double re = m_phaseRe * stepRe - m_phaseIm * stepIm;
+	const double im = m_phaseRe * stepIm + m_phaseIm * stepRe;
+	const double norm = 1 / std::sqrt(re * re + im * im);
+	m_phaseRe = re * norm;
+	m_phaseIm = im * norm;
+}
+
+template <typename Sample>
+int IqDemodulator::process(const Sample *samples, int count, SampleRing<Sample> &outI, SampleRing<Sample> &outQ)
+{
+	int produced = 0;
+	double *i = m_i.data();
+	double *q = m_q.data();
+
+	for (int done = 0; done < count; )
+	{
+		const int n = qMin<int>(BlockSize, count - done);
+		mix(samples + done, n, i, q);
+
+		// decimate in place, filter what is left, then hand the block over
+		// in one push per ring
+		double *channels[2] = { i, q };
+		const int kept = m_decimator.process(n, channels);
+		m_lowPass.process(kept, channels);
+		outI.push(i, kept);
+		outQ.push(q, kept);
+
+		produced += kept;
+		done += n;
+	}
+	return produced;
+}
+
+template int IqDemodulator::process(const float *, int, SampleRing<float> &, SampleRing<float> &);
+template int IqDemodulator::process(const double *, int, SampleRing<double> &, SampleRing<double> &);
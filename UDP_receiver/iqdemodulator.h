@@ -0,0 +1,68 @@
+#ifndef IQDEMODULATOR_H
+#define IQDEMODULATOR_H
+
+#include <QVector>
+#include "samplering.h"
+#include "DspFilters/Dsp.h"
+
+/*
+ * Streaming quadrature demodulator for one receive channel.
+ *
+ * A numerically controlled oscillator at the transmit frequency mixes the
+ * channel down to complex baseband, x * 2 exp(-i w n), so that a carrier
+ * of amplitude A and phase theta comes out as I + iQ = A exp(i theta) and
+ * a Doppler shift as a slow rotation. I and Q are decimated right after
+ * mixing (see Dsp::Decimator), which removes the image at twice the carrier
+ * along with everything else that would fold into the baseband, and the
+ * low-pass that sets the bandwidth then runs at the output rate only.
+ *
+ * The oscillator is recursive: a table holds exp(-i w k) for one block of
+ * BlockSize samples, and each block multiplies the table by the phasor of
+ * its first sample. The mixing loop is therefore plain multiplications over
+ * arrays, which the compiler vectorizes, and the phasor is renormalized
+ * once per block so its amplitude never drifts. The phase carries over
+ * between calls and across setParams().
+ */
+class IqDemodulator
+{
+public:
+	enum { BlockSize = 256 };
+
+	IqDemodulator();
+
+	// Redesigns the oscillator and the filters if any value changed.
+	// decimation must be a power of two.
+	void setParams(double sampleRate, double carrier, double cutoff, int decimation);
+	int decimation() const { return m_decimation; }
+
+	// Mixes count input samples down and appends the decimated I and Q
+	// samples to outI and outQ. Returns the number of samples appended to each.
+	// Sample is float or double; the mixing and the filters run in double.
+	template <typename Sample>
+	int process(const Sample *samples, int count, SampleRing<Sample> &outI, SampleRing<Sample> &outQ);
+
+private:
+	template <typename Sample>
+	void mix(const Sample *samples, int count, double *i, double *q);
+
+	double m_sampleRate;
+	double m_carrier;
+	double m_cutoff;
+	int m_decimation;
+
+	// oscillator: phasor of the next sample, per-sample and per-block steps
+	double m_phaseRe;
+	double m_phaseIm;
+	QVector<double> m_stepRe;
+	QVector<double> m_stepIm;
+	double m_blockStepRe;
+	double m_blockStepIm;
+
+	Dsp::Decimator<2> m_decimator;
+	Dsp::SimpleFilter<Dsp::Butterworth::LowPass<4>, 2> m_lowPass;	// at the output rate
+
+	QVector<double> m_i;
+	QVector<double> m_q;
+};
+
+#endif
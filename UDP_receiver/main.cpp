@@ -1,13 +1,20 @@
 #include <QApplication>
+#include <cstring>
 
 #include "networkcontroller.h"
 #include "networkgui.h"
 #include "mainwindow.h"
+#include "benchmark.h"
 
 class NetworkController;
 
 int main(int argc, char *argv[])
 {
+	// timing runs need neither the display nor the network
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "--bench") == 0)
+			return runBenchmarks();
+
 	QApplication app(argc, argv);
 	NetworkController *controller = new NetworkController();
 	MainWindow w(0, controller);
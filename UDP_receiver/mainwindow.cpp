@@ -6,6 +6,7 @@
 #include <QScreen>
 #include <QMessageBox>
 #include <QMetaEnum>
+#include <QElapsedTimer>
 #include "DspFilters/Dsp.h"
 
 MainWindow::MainWindow(QWidget *parent, NetworkController *netc) :
@@ -16,6 +17,12 @@ MainWindow::MainWindow(QWidget *parent, NetworkController *netc) :
   setGeometry(400, 250, 542, 390);
   nc = netc;
 
+  dsp = new DspThread(nc->ring_T, nc->ring_ra);
+  dsp->setParams(sampleRate, QFactor);
+  dsp->setCarrier(carrier);
+  dsp->setDecimation(decimation);
+  dsp->start(QThread::HighPriority);
+
   setupPlot(ui->customPlot);
   setWindowTitle("QCustomPlot: "+demoName);
   statusBar()->clearMessage();
@@ -31,6 +38,9 @@ MainWindow::MainWindow(QWidget *parent, NetworkController *netc) :
 
 void MainWindow::keyPressEvent(QKeyEvent *e)
 {
+	// the render thread may be reading the plot; let it finish before we change it
+	ui->customPlot->waitForRender();
+
 	switch(e->key()){
 		case(Qt::Key_Escape):
 			close();
@@ -38,25 +48,33 @@ void MainWindow::keyPressEvent(QKeyEvent *e)
 		//case(Qt::Key_J): 		glWidget->increaseC(); break;
 		//case(Qt::Key_K): 		glWidget->decreaseC(); break;
 		
-		case(Qt::Key_1): 		updatePlot[0] = !updatePlot[0]; ui->customPlot->graph(0)->setVisible(updatePlot[0]); break;
-		case(Qt::Key_2): 		updatePlot[1] = !updatePlot[1]; ui->customPlot->graph(1)->setVisible(updatePlot[1]); break;
-		case(Qt::Key_3): 		updatePlot[2] = !updatePlot[2]; ui->customPlot->graph(2)->setVisible(updatePlot[2]); break;
-
-		case(Qt::Key_H): xrange *= 2; ui->customPlot->xAxis->setRange(0, xrange); break;
-		case(Qt::Key_G): xrange /= 2; ui->customPlot->xAxis->setRange(0, xrange); break;
-		case(Qt::Key_K): yrange *= 2; ui->customPlot->yAxis->setRange(-yrange, yrange); break;
-		case(Qt::Key_J): yrange /= 2; ui->customPlot->yAxis->setRange(-yrange, yrange); break;
-		case(Qt::Key_E): 		QFactor += 0.1; cout << QFactor << endl; break;
-		case(Qt::Key_R): 		QFactor -= 0.1; cout << QFactor << endl; break;
+		case(Qt::Key_1): 		updatePlot[0] = !updatePlot[0]; stream[0]->setVisible(updatePlot[0]); break;
+		case(Qt::Key_2): 		updatePlot[1] = !updatePlot[1]; stream[1]->setVisible(updatePlot[1]); break;
+		case(Qt::Key_3): 		updatePlot[2] = !updatePlot[2]; stream[2]->setVisible(updatePlot[2]); break;
+		case(Qt::Key_4): 		updatePlot[3] = !updatePlot[3]; stream[3]->setVisible(updatePlot[3]); break;
+		case(Qt::Key_5): 		updatePlot[4] = !updatePlot[4]; stream[4]->setVisible(updatePlot[4]); break;
+		case(Qt::Key_C): 		carrier += 500; cout << "carrier : " << carrier << endl; dsp->setCarrier(carrier); break;
+		case(Qt::Key_V): 		carrier -= 500; cout << "carrier : " << carrier << endl; dsp->setCarrier(carrier); break;
+
+		case(Qt::Key_P): 		setPersistence(!persistence->visible()); break;
+		case(Qt::Key_F): 		setWaterfall(!waterfall); break;
+
+		case(Qt::Key_H): xrange *= 2; setScrollWindow(xrange); resetPersistence(); break;
+		case(Qt::Key_G): xrange /= 2; setScrollWindow(xrange); resetPersistence(); break;
+		case(Qt::Key_K): yrange *= 2; ui->customPlot->yAxis->setRange(-yrange, yrange); resetPersistence(); break;
+		case(Qt::Key_J): yrange /= 2; ui->customPlot->yAxis->setRange(-yrange, yrange); resetPersistence(); break;
+		case(Qt::Key_E): 		QFactor += 0.1; cout << QFactor << endl; dsp->setParams(sampleRate, QFactor); break;
+		case(Qt::Key_R): 		QFactor -= 0.1; cout << QFactor << endl; dsp->setParams(sampleRate, QFactor); break;
 		case(Qt::Key_Space): 	nc->updateVectors = !nc->updateVectors; break;
 		//case(Qt::Key_W): 		glWidget->viewUp(); break;
-		case(Qt::Key_A): 		lowPass = !lowPass; cout << "low pass filter : " << lowPass << endl; redraw();  break;
-		case(Qt::Key_S): 		highPass = !highPass; cout << "high pass filter : " << highPass << endl; redraw();  break;
+		case(Qt::Key_A): 		lowPass = !lowPass; cout << "low pass filter : " << lowPass << endl; dsp->setLowPass(lowPass);  break;
+		case(Qt::Key_S): 		highPass = !highPass; cout << "high pass filter : " << highPass << endl; dsp->setHighPass(highPass);  break;
 		//case(Qt::Key_D): 		glWidget->viewRight(); break;
+		case(Qt::Key_D): 		setDecimation(decimation < DspPipeline::MaxDecimation ? decimation * 2 : 1); break;
 
 
-		case(Qt::Key_Equal): 	sampleRate += 1000; cout << sampleRate << endl; break;
-		case(Qt::Key_Minus): 	sampleRate -= 1000; cout << sampleRate << endl; break;
+		case(Qt::Key_Equal): 	setSampleRate(sampleRate + 1000); break;
+		case(Qt::Key_Minus): 	setSampleRate(sampleRate - 1000); break;
 		//default:
 			//QWidget::keyPressEvent(e);
 		break;
@@ -66,61 +84,43 @@ void MainWindow::keyPressEvent(QKeyEvent *e)
 
 void MainWindow::redraw(){
 
-	nc->T = nc->q_T.toVector();
-	nc->ra = nc->q_ra.toVector();
-	//nc->rb = nc->q_rb.toVector();
-
-	for (int i=0; i<100000; ++i){
-		nc->T[i] *=0.1;
+	// the last frame is still being rendered: leave the DSP output for the
+	// next tick instead of queueing another replot behind it
+	if (ui->customPlot->isRendering())
+	{
+		showStatus();
+		return;
 	}
 
-	
-	if(highPass){
-		double *highpassdata = nc->ra.data();
-		double *highpassd[1];
-		highpassd[0] = highpassdata;
-
-		Dsp::Filter* highPassFilter = new Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::HighPass, 1> (1024);
-		Dsp::Params paramsHigh;
-		paramsHigh[0] = sampleRate; // sample rate
-		//params[0] = 1000000; // sample rate
-		paramsHigh[1] = 1000; // cutoff frequency
-		paramsHigh[2] = QFactor; // Q
-		//params[2] = 1.0; // Q
-		highPassFilter->setParams (paramsHigh);
-		highPassFilter->process (100000, highpassd);
-
+	// the DSP thread has done the filtering; just pick up its newest frame
+	const DspFrame *frame = dsp->takeFrame();
+	if (!frame)
+	{
+		showStatus();
+		return;
 	}
 
-	for (int i=0; i<100000; ++i){
-		nc->rb[i] = nc->T[i] * nc->ra[i] / 500;
-	}
+	plotTime.start();
 
-	if(lowPass){
-		double *data_cosa = nc->rb.data();
-		double *audioData[1];
-		audioData[0] = data_cosa;
-		//audioData[1] = data_sina;
-		//audioData[2] = data_cosb;
-		//audioData[3] = data_sinb;
-		//
-		Dsp::Filter* lowPassFilter = new Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::LowPass, 1> (1024);
-		Dsp::Params params;
-		params[0] = sampleRate; // sample rate
-		//params[0] = 1000000; // sample rate
-		params[1] = 100; // cutoff frequency
-		params[2] = QFactor; // Q
-		//params[2] = 1.0; // Q
-		lowPassFilter->setParams (params);
-		lowPassFilter->process (100000, audioData);
+	// follow the rate the sender announces; the keys override it until the
+	// stream changes its rate again
+	const quint32 announced = nc->streamSampleRate();
+	if (announced != streamRate)
+	{
+		streamRate = announced;
+		if (streamRate != 0)
+			setSampleRate(int(streamRate));
 	}
 
-	if(updatePlot[0])
-		ui->customPlot->graph(0)->setData(nc->x,nc->T);
-	if(updatePlot[1])
-		ui->customPlot->graph(1)->setData(nc->x,nc->ra);
-	if(updatePlot[2])
-		ui->customPlot->graph(2)->setData(nc->x,nc->rb);
+	// the graphs read the DSP output rings in place; just move their end
+	streamSource[0]->setEnd(frame->end);
+	streamSource[1]->setEnd(frame->end);
+	streamSource[2]->setEnd(frame->rbEnd);
+	streamSource[3]->setEnd(frame->demodEnd);
+	streamSource[4]->setEnd(frame->demodEnd);
+	if (persistence->visible())
+		feedPersistence(frame->end);
+	feedWaterfall(frame->spectrumEnd);
 
 	// Vector Doppler
 
@@ -163,28 +163,232 @@ void MainWindow::redraw(){
 	//ui->customPlot->graph(1)->setData(nc->x,nc->I_par);
 	//ui->customPlot->graph(2)->setData(nc->x,nc->I_perp);
 	//ui->customPlot->graph(0)->setData(nc->x,nc->ra);
-	//ui->customPlot->graph(0)->setData(nc->x,nc->q_ra.toVector());
 	//ui->customPlot->graph(1)->setData(nc->x,nc->cos_a);
 	//ui->customPlot->graph(2)->setData(nc->x,nc->cos_b);
 	//ui->customPlot->graph(1)->setData(nc->x,nc->r0);
 	//ui->customPlot->graph(1)->setData(nc->x,nc->T_90);
 	//
 	ui->customPlot->replot();
+
+	frameDspMs = frame->dspMs;
+
+	showStatus();
+}
+
+void MainWindow::frameShown()
+{
+	// the render thread finished the frame started in redraw()
+	if (plotTime.isValid())
+		framePlotMs = plotTime.nsecsElapsed() / 1e6;
+}
+
+void MainWindow::showStatus()
+{
+	// report ingest statistics and the frame time budget about once a second:
+	double key = QDateTime::currentDateTime().toMSecsSinceEpoch()/1000.0;
+	static double lastStatusKey;
+	if (key-lastStatusKey > 1)
+	{
+		ui->statusBar->showMessage(
+			QString("Datagrams received: %1, dropped: %2, lost: %3, reordered: %4, malformed: %5 | "
+				"DSP skipped %9 samples | frame: DSP %6 ms, plot %7 ms of %8 ms")
+			.arg(nc->datagramsReceived())
+			.arg(nc->datagramsDropped())
+			.arg(nc->packetsLost())
+			.arg(nc->packetsReordered())
+			.arg(nc->packetsMalformed())
+			.arg(frameDspMs, 0, 'f', 1)
+			.arg(framePlotMs, 0, 'f', 1)
+			.arg(dataTimer.interval())
+			.arg(dsp->skippedSamples())
+			, 0);
+		lastStatusKey = key;
+	}
+}
+
+void MainWindow::setScrollWindow(int samples)
+{
+	// the newest sample is drawn at the right edge of the key axis
+	stream[0]->setScrollWindow(samples);
+	stream[1]->setScrollWindow(samples);
+	// the decimated graphs step one key per input sample they stand for
+	stream[2]->setScrollWindow(samples / decimation);
+	stream[3]->setScrollWindow(samples / DspPipeline::DemodDecimation);
+	stream[4]->setScrollWindow(samples / DspPipeline::DemodDecimation);
+	ui->customPlot->xAxis->setRange(0, samples);
+}
+
+void MainWindow::setDecimation(int ratio)
+{
+	decimation = ratio;
+	cout << "decimation : " << decimation << endl;
+	dsp->setDecimation(decimation);
+	stream[2]->setSamplePeriod(decimation);
+	setScrollWindow(xrange);
+}
+
+void MainWindow::setSampleRate(int rate)
+{
+	sampleRate = rate;
+	cout << "sample rate : " << sampleRate << endl;
+	dsp->setParams(sampleRate, QFactor);
+	if (waterfall)
+		updateWaterfallAxes();
+}
+
+void MainWindow::setPersistence(bool enabled)
+{
+	// the phosphor view replaces the scrolling graphs while it is shown
+	for (int i = 0; i < 5; ++i)
+		stream[i]->setVisible(!enabled && updatePlot[i]);
+	persistence->setVisible(enabled);
+	resetPersistence();
+}
+
+void MainWindow::resetPersistence()
+{
+	// one key cell per pixel or so; the history is meaningless after a
+	// change of the axes, so start over
+	persistence->setGrid(1024, 512, QCPRange(0, xrange), QCPRange(-yrange, yrange));
+	persistenceNext = dsp->outRa().written();
+}
+
+void MainWindow::feedPersistence(quint64 end)
+{
+	const SampleRing<DspSample> &ring = dsp->outRa();
+	if (end < persistenceNext)
+		return; // frame from before the last resetPersistence()
+
+	// don't read what the DSP thread may be overwriting; if we fell that far
+	// behind, skip ahead like DspPipeline::process() does
+	const quint64 limit = quint64(ring.capacity() / 2);
+	if (end - persistenceNext > limit)
+		persistenceNext = end - limit;
+
+	// one sweep per window of xrange samples, the same span the graphs show
+	sweep.resize(xrange);
+	while (end - persistenceNext >= quint64(xrange) && quint64(xrange) <= limit)
+	{
+		const SampleRing<DspSample>::View view = ring.range(persistenceNext, xrange);
+		view.copyTo(sweep.data());
+		if (!ring.isIntact(view))
+		{
+			// the DSP thread overwrote part of it while we copied; drop the
+			// batch and pick up again at the frame's end
+			persistenceNext = end;
+			return;
+		}
+		persistence->addSweep(sweep, 0, 1);
+		persistenceNext += xrange;
+	}
+}
+
+void MainWindow::setWaterfall(bool enabled)
+{
+	QCustomPlot *customPlot = ui->customPlot;
+	if (!enabled)
+	{
+		customPlot->removePlottable(waterfall);
+		customPlot->plotLayout()->remove(waterfallRect);
+		customPlot->plotLayout()->simplify();
+		waterfall = 0;
+		waterfallRect = 0;
+		return;
+	}
+
+	// frequency across, time down, in an axis rect of its own below the graphs
+	waterfallRect = new QCPAxisRect(customPlot);
+	customPlot->plotLayout()->addElement(1, 0, waterfallRect);
+	QCPAxis *frequencyAxis = waterfallRect->axis(QCPAxis::atBottom);
+	QCPAxis *timeAxis = waterfallRect->axis(QCPAxis::atLeft);
+	frequencyAxis->setLabel("Hz");
+	timeAxis->setLabel("s");
+
+	const int bins = dsp->spectrumBins();
+	waterfall = new QCPColorMap(frequencyAxis, timeAxis);
+	customPlot->addPlottable(waterfall);
+	waterfall->data()->setSize(bins, WaterfallRows);
+	waterfall->setGradient(QCPColorGradient::gpJet);
+	waterfall->setDataRange(QCPRange(0, 80)); // dB
+	updateWaterfallAxes();
+
+	spectrumColumn.resize(bins);
+	waterfallNext = dsp->outSpectrum().written() / bins;
+}
+
+void MainWindow::updateWaterfallAxes()
+{
+	// the bin frequencies and the time per column follow the sample rate
+	const int bins = dsp->spectrumBins();
+	const double columnSeconds = double(DspPipeline::SpectrumHop) * DspPipeline::SpectrumDecimation / sampleRate;
+	waterfall->data()->setRange(QCPRange(0, dsp->spectrumFrequency(bins - 1, sampleRate)),
+		QCPRange(-(WaterfallRows - 1) * columnSeconds, 0));
+	waterfall->rescaleAxes();
+}
+
+void MainWindow::feedWaterfall(quint64 columns)
+{
+	if (!waterfall || columns < waterfallNext)
+		return;
+
+	const SampleRing<DspSample> &ring = dsp->outSpectrum();
+	const int bins = dsp->spectrumBins();
+	QCPColorMapData *data = waterfall->data();
+
+	// skip columns the DSP thread may be overwriting, and columns that would
+	// scroll out of view right away
+	const quint64 kept = qMin<quint64>(WaterfallRows, ring.capacity() / 2 / bins);
+	if (columns - waterfallNext > kept)
+		waterfallNext = columns - kept;
+	const int count = int(columns - waterfallNext);
+	if (count == 0)
+		return;
+
+	// the map only colorizes the new rows; the rest of its image scrolls down
+	data->scrollValueRows(count);
+	for (int row = WaterfallRows - count; waterfallNext < columns; ++row, ++waterfallNext)
+	{
+		const SampleRing<DspSample>::View view = ring.range(waterfallNext * bins, bins);
+		view.copyTo(spectrumColumn.data());
+		// a column the DSP thread overwrote while we copied it is left blank
+		const bool intact = ring.isIntact(view);
+		for (int bin = 0; bin < bins; ++bin)
+			data->setCell(bin, row, intact ? spectrumColumn[bin] : 0);
+	}
 }
 
 void MainWindow::setupPlot(QCustomPlot *customPlot)
 {
   demoName = "Quadratic Demo";
-  // create graph and assign data to it:
-  customPlot->addGraph();
-  customPlot->addGraph();
-  customPlot->addGraph();
-  customPlot->graph(0)->setPen(QPen(Qt::blue)); // line color blue for first graph
-  customPlot->graph(1)->setPen(QPen(Qt::red)); // line color red for second graph
-  customPlot->graph(2)->setPen(QPen(Qt::green)); // line color red for second graph
-  customPlot->graph(0)->setData(nc->x,nc->T);
-  //customPlot->graph(1)->setData(nc->x,nc->r0);
-  customPlot->graph(2)->setData(nc->x,nc->m);
+  // create graphs, one scrolling graph per output ring of the DSP thread:
+  streamSource[0] = new RingPlotSource(dsp->outT());
+  streamSource[1] = new RingPlotSource(dsp->outRa());
+  streamSource[2] = new RingPlotSource(dsp->outRb());
+  streamSource[3] = new RingPlotSource(dsp->outI());
+  streamSource[4] = new RingPlotSource(dsp->outQ());
+  for (int i=0; i<5; ++i)
+  {
+    stream[i] = new QCPStreamGraph(customPlot->xAxis, customPlot->yAxis);
+    stream[i]->setSource(streamSource[i]);
+    stream[i]->setVisible(updatePlot[i]);
+    customPlot->addPlottable(stream[i]);
+  }
+  stream[0]->setPen(QPen(Qt::blue)); // line color blue for first graph
+  stream[1]->setPen(QPen(Qt::red)); // line color red for second graph
+  stream[2]->setPen(QPen(Qt::green)); // line color red for second graph
+  stream[3]->setPen(QPen(Qt::magenta)); // in-phase baseband
+  stream[4]->setPen(QPen(Qt::darkCyan)); // quadrature baseband
+  stream[2]->setSamplePeriod(decimation);
+  stream[3]->setSamplePeriod(DspPipeline::DemodDecimation);
+  stream[4]->setSamplePeriod(DspPipeline::DemodDecimation);
+  setScrollWindow(xrange);
+  // overlaid sweeps of the received echo, hidden until toggled with P:
+  persistence = new QCPPersistenceMap(customPlot->xAxis, customPlot->yAxis);
+  persistence->setDecay(0.95);
+  persistence->setDataRange(QCPRange(0, persistence->saturation()));
+  persistence->setVisible(false);
+  customPlot->addPlottable(persistence);
+  resetPersistence();
   // give the axes some labels:
   customPlot->xAxis->setLabel("x");
   customPlot->yAxis->setLabel("y");
@@ -192,10 +396,18 @@ void MainWindow::setupPlot(QCustomPlot *customPlot)
   //customPlot->xAxis->setRange(0, 1000);
   //customPlot->xAxis->setRange(0, 5000);
   //customPlot->xAxis->setRange(0, 10000);
-  customPlot->xAxis->setRange(0, 100000);
   //customPlot->yAxis->setRange(-10000, 10000);
   customPlot->yAxis->setRange(-5000, 5000);
   customPlot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom | QCP::iSelectPlottables);
+  // only the graphs on the "main" layer change from frame to frame; keep the
+  // axis rect background, grid, axes and legend as cached images:
+  customPlot->layer("background")->setCached(true);
+  customPlot->layer("grid")->setCached(true);
+  customPlot->layer("axes")->setCached(true);
+  customPlot->layer("legend")->setCached(true);
+  // paint frames on a render thread so ingest and input stay responsive while plotting
+  customPlot->setThreadedRendering(true);
+  connect(customPlot, SIGNAL(afterReplot()), this, SLOT(frameShown()));
 }
 
 //void MainWindow::setupSimpleDemo(QCustomPlot *customPlot)
@@ -1615,6 +1827,9 @@ void MainWindow::bracketDataSlot()
 MainWindow::~MainWindow()
 {
   delete ui;
+  for (int i=0; i<5; ++i)
+    delete streamSource[i];
+  delete dsp;
 }
 
 void MainWindow::screenShot()
@@ -4,8 +4,11 @@
 
 #include <QMainWindow>
 #include <QTimer>
+#include <QElapsedTimer>
 #include "qcustomplot.h" // the header file of QCustomPlot. Don't forget to add it to your project, if you use an IDE, so it gets compiled.
 #include "networkcontroller.h"
+#include "dspthread.h"
+#include "ringplotsource.h"
 #include "DspFilters/Dsp.h"
 #include <iostream>
 
@@ -26,10 +29,21 @@ public:
   ~MainWindow();
   void setupDemo(int demoIndex);
   void setupPlot(QCustomPlot *customPlot);
+  void setScrollWindow(int samples);
+  void setDecimation(int ratio);
+  void setSampleRate(int rate);
+  void setPersistence(bool enabled);
+  void resetPersistence();
+  void feedPersistence(quint64 end);
+  void setWaterfall(bool enabled);
+  void updateWaterfallAxes();
+  void feedWaterfall(quint64 columns);
+  void showStatus();
   
 private slots:
   void realtimeDataSlot();
   void redraw();
+  void frameShown();
   void bracketDataSlot();
   void screenShot();
   void allScreenShots();
@@ -45,14 +59,39 @@ private:
   int currentDemoIndex;
   NetworkController *nc;
   int sampleRate = 100000;
+  // last rate announced in the stream's packet headers, 0 before the first
+  quint32 streamRate = 0;
   int xrange = 100000;
   int yrange = 5000;
   double QFactor = 0.3;
-  int updatePlot[3] = {1, 1, 0};
+  double carrier = 40000;
+  int decimation = DspPipeline::DefaultDecimation;
+  int updatePlot[5] = {1, 1, 0, 0, 0};
 
   bool updatePlots = 1;
   bool lowPass = 1;
   bool highPass = 1;
+
+  // mixing and filtering of the incoming stream, on its own thread
+  DspThread *dsp;
+  // graphs 1-3, plotting the output rings of dsp in place, and graphs
+  // 4-5 with the I/Q baseband, which has fewer samples for the same time
+  RingPlotSource *streamSource[5];
+  QCPStreamGraph *stream[5];
+  // phosphor view of the received echo, one sweep per xrange samples
+  QCPPersistenceMap *persistence;
+  quint64 persistenceNext = 0;
+  QVector<double> sweep;
+  // spectrogram of the Doppler baseband below the graphs, newest column on top
+  enum { WaterfallRows = 256 };
+  QCPAxisRect *waterfallRect = 0;
+  QCPColorMap *waterfall = 0;
+  quint64 waterfallNext = 0;
+  QVector<double> spectrumColumn;
+  // frame time of the last plotted frame, for the status bar
+  QElapsedTimer plotTime;
+  double frameDspMs = 0;
+  double framePlotMs = 0;
 };
 
 #endif // MAINWINDOW_H
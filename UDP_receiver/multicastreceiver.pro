@@ -3,14 +3,44 @@ QT += core
 
 SUBDIRS += source
 INCLUDEPATH += DspFilter
+INCLUDEPATH += ../cpp # streamformat.h, shared with the sender
 
 LIBS += -L/usr/local/lib/ -lDSPFilters
 
+# the inner loops of the FFT and the plottables are written for the
+# compiler to vectorize, which -O2 alone does not do
+QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
+
+# qmake CONFIG+=float_samples runs the receive chain in single precision
+# (see DspSample in samplering.h)
+float_samples: DEFINES += RECEIVER_FLOAT_SAMPLES
+
+# qmake CONFIG+=avx builds for CPUs with AVX; Dsp::ParallelDirectFormII
+# then filters four channels per instruction instead of two
+avx: QMAKE_CXXFLAGS += -mavx
+
 HEADERS       = networkcontroller.h \
+				ingestthread.h \
+				dsppipeline.h \
+				dspthread.h \
+				spectrogram.h \
+				iqdemodulator.h \
+				fft.h \
+				benchmark.h \
+				samplering.h \
+				ringplotsource.h \
 				networkgui.h \
 				mainwindow.h \
-				qcustomplot.h
+				qcustomplot.h \
+				../cpp/streamformat.h
 SOURCES       = networkcontroller.cpp \
+				ingestthread.cpp \
+				dsppipeline.cpp \
+				dspthread.cpp \
+				spectrogram.cpp \
+				iqdemodulator.cpp \
+				fft.cpp \
+				benchmark.cpp \
 				networkgui.cpp \
 				qcustomplot.cpp \
 				mainwindow.cpp \
@@ -2,20 +2,25 @@
 #include <QtNetwork>
 #include <QDebug>
 #include <QProcess>
+#include <string.h>
+#include <algorithm>
 
 #include "networkcontroller.h"
+#include "ingestthread.h"
 
 NetworkController::NetworkController()
+	: updateVectors(true)
+	, lostPackets(0)
+	, reorderedPackets(0)
+	, malformedPackets(0)
+	, sampleRate(0)
 {
 	qDebug() << "initialising network controller";
     groupAddress = QHostAddress("localhost");
 
     udpSocket = new QUdpSocket(this);
-	udpSocket->bind(QHostAddress::LocalHost, 45454);
 	//udpSocket->connectToHost(groupAddress, 45454);
 
-	QObject::connect(udpSocket, SIGNAL(readyRead()),
-            this, SLOT(processPendingDatagrams()));
 	T = QVector<double>(100000);
 	T_90 = QVector<double>(100000);
 	ra = QVector<double>(100000);
@@ -44,9 +49,6 @@ NetworkController::NetworkController()
 	x = QVector<double>(100000);
 	for (int i=0; i<100000; ++i)
 	{
-		q_T.enqueue(i);
-		q_ra.enqueue(i);
-		q_rb.enqueue(i);
 		T[i] = i/5000.0 - 1; 
 		T_90[i] = i/5000.0 - 1; 
 		m[i] = i/5000.0 - 1; 
@@ -63,95 +65,173 @@ NetworkController::NetworkController()
 		cos_b[i] = i;
 		sin_b[i] = i;
 	}
+
+	// scratch space for one datagram's worth of converted samples
+	scratch_T = QVector<DspSample>(IngestThread::MaxDatagramSize / sizeof(qint16));
+	scratch_ra = QVector<DspSample>(IngestThread::MaxDatagramSize / sizeof(qint16));
+
+	// the socket is drained on its own thread; see IngestThread
+	ingestThread = new IngestThread(this, 45454);
+	ingestThread->start(QThread::TimeCriticalPriority);
 }
 
-void NetworkController::processPendingDatagrams()
+NetworkController::~NetworkController()
 {
-	//QByteArray data = udpSocket->readAll();
-    while (udpSocket->hasPendingDatagrams()) {
-		QByteArray datagram;
-        datagram.resize(udpSocket->pendingDatagramSize());
-        udpSocket->readDatagram(datagram.data(), datagram.size());
-        //statusLabel->setText(tr("Received datagram: \"%1\"")
-        //                     .arg(datagram.data()));
-		
-		QDataStream ds(datagram);
-		ds.setByteOrder(QDataStream::LittleEndian);
-
-		int packetSize = datagram.size() / (4 * 3);
-		//qDebug() << "Packetsize: " << packetSize;
-
-
-		int value_t;
-		int value_r;
-
-		for(int i = 0; i < packetSize; i++){
-			packetCount++;
-			ds >> value_t;
-			ds >> value_r;
-
-			if(updateVectors){
-
-				//value_t /= 100.0;
-				q_T.dequeue();
-				q_T.enqueue(value_t);
-				//T.pop_back();
-				//T.push_front(value_t);
-				value_r*=250;
-				//value_r*=2;
-				//ra.pop_back();
-				//ra.push_front(value_r);
-				q_ra.enqueue(value_r);
-				q_ra.dequeue();
-				//int value_m = value_t * value_r / 10000.0;
-				//q_rb.enqueue(value_m);
-				//q_rb.dequeue();
-				
-				//cos_a_raw.pop_back();
-				//cos_a_raw.push_front(value_m);
-				//T_90.pop_back();
-				//T_90.push_front(T[3]); // 90 degree phase shift
-				//value_m = T[3] * value_r / 5000.0;
-				//sin_a_raw.pop_back();
-				//sin_a_raw.push_front(value_m);
-
-				//ds >> value_r;
-				
-				//value_r*=200;
-				//rb.pop_back();
-				//rb.push_front(value_r);
-				//value_m = value_t * value_r / 5000.0;
-				//cos_b_raw.pop_back();
-				//cos_b_raw.push_front(value_m);
-				//value_m = T[3] * value_r / 5000.0;
-				//sin_b_raw.pop_back();
-				//sin_b_raw.push_front(value_m);
-			}
+	delete ingestThread;
+}
+
+quint64 NetworkController::datagramsReceived() const
+{
+	return ingestThread->datagramsReceived();
+}
+
+quint64 NetworkController::datagramsDropped() const
+{
+	return ingestThread->datagramsDropped();
+}
+
+void NetworkController::processDatagram(const char *data, int size)
+{
+	DOPPLER_PACKET_HEADER header;
+	if (size < int(sizeof(header)))
+	{
+		++malformedPackets;
+		return;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	// the payload size must match the header exactly
+	const quint32 sampleSize = dopplerSampleSize(header.sampleFormat);
+	if (header.magic != DOPPLER_STREAM_MAGIC
+		|| header.version != DOPPLER_STREAM_VERSION
+		|| header.channelCount == 0 || header.channelCount > DOPPLER_MAX_CHANNELS
+		|| header.headerSize < dopplerHeaderSize(header.channelCount)
+		|| sampleSize == 0
+		|| quint64(size) != header.headerSize + quint64(header.sampleCount) * header.channelCount * sampleSize)
+	{
+		++malformedPackets;
+		return;
+	}
+
+	// sequence numbers wrap, so compare them as a signed distance;
+	// a sequence of 0 means the sender has restarted the stream
+	if (streamStarted && header.sequence != 0)
+	{
+		qint32 distance = qint32(header.sequence - expectedSequence);
+		if (distance < 0)
+		{
+			// its samples are already behind the write position of the rings
+			++reorderedPackets;
+			return;
 		}
+		lostPackets += distance;
+	}
+	else
+	{
+		nextSample = header.firstSample;
+	}
+	streamStarted = true;
+	expectedSequence = header.sequence + 1;
+	sampleRate.store(header.sampleRate, std::memory_order_relaxed);
+
+	if (!updateVectors)
+	{
+		nextSample = header.firstSample + header.sampleCount;
+		return;
+	}
 
-		//ds >> value_t;
-		//T.pop_back();
-		//T.push_front(value_t);
-		//ds >> value_r;
-		//value_r*=10;
-		//r0.pop_back();
-		//r0.push_front(value_r);
-		//int value_m = value_t * value_r / 5000.0;
-		//m.pop_back();
-		//m.push_front(value_m);
-		////QString s_data = QString(datagram.data());
-		////qDebug() << value;
-		//T_90.pop_back();
-		////T_90.push_front(T[1]);
-		//T_90.push_front(T[3]);
-		
-		if(packetCount > 1000000){
-			//QString s_data = QString(datagram.data());
-			//qDebug() << s_data;
-			//qDebug() << " FINISHED ";
+	// keep the rings aligned with sample time across lost datagrams
+	if (header.firstSample > nextSample)
+		padRings(header.firstSample - nextSample);
+	nextSample = header.firstSample + header.sampleCount;
+
+	// channel A drives T and channel B drives ra; a channel that is
+	// not in the stream reads as zero
+	int slot_T = -1;
+	int slot_ra = -1;
+	DOPPLER_CHANNEL_HEADER channels[DOPPLER_MAX_CHANNELS];
+	memcpy(channels, data + sizeof(header), header.channelCount * sizeof(DOPPLER_CHANNEL_HEADER));
+	for (int c = 0; c < header.channelCount; ++c)
+	{
+		if (channels[c].channel == 0)
+			slot_T = c;
+		else if (channels[c].channel == 1)
+			slot_ra = c;
+	}
+
+	const char *payload = data + header.headerSize;
+	const int count = header.sampleCount;
+	convertChannel(header, channels, payload, slot_T, 1.0, scratch_T.data());
+	convertChannel(header, channels, payload, slot_ra, 250.0, scratch_ra.data());
+	ring_T.push(scratch_T.constData(), count);
+	ring_ra.push(scratch_ra.constData(), count);
+}
+
+template <typename Sample>
+static void convertSamples(const char *payload, int first, int stride, int count, double scale, DspSample *dest)
+{
+	const Sample *src = reinterpret_cast<const Sample *>(payload) + first;
+	if (stride == 1)
+	{
+		// contiguous, so the compiler can vectorize the conversion
+		for (int i = 0; i < count; ++i)
+			dest[i] = DspSample(src[i] * scale);
+	}
+	else
+	{
+		for (int i = 0; i < count; ++i)
+			dest[i] = DspSample(src[i * stride] * scale);
+	}
+}
+
+/*
+ * Converts one channel of a validated datagram to millivolts times gain.
+ * Raw ADC counts are scaled with the range carried in the channel header.
+ */
+void NetworkController::convertChannel(const DOPPLER_PACKET_HEADER &header, const DOPPLER_CHANNEL_HEADER *channels,
+	const char *payload, int slot, double gain, DspSample *dest)
+{
+	const int count = header.sampleCount;
+	if (slot < 0)
+	{
+		std::fill(dest, dest + count, DspSample(0));
+		return;
+	}
+
+	int first = slot;
+	int stride = header.channelCount;
+	if (header.flags & DOPPLER_FLAG_PLANAR)
+	{
+		first = slot * count;
+		stride = 1;
+	}
+
+	switch (header.sampleFormat)
+	{
+	case DOPPLER_FORMAT_S32_MV:
+		convertSamples<qint32>(payload, first, stride, count, gain, dest);
+		break;
+	case DOPPLER_FORMAT_S16_ADC:
+		if (channels[slot].maxValue == 0)
+		{
+			std::fill(dest, dest + count, DspSample(0));
+			break;
 		}
-		//char value = (datagram.data())[0];
-    }
+		convertSamples<qint16>(payload, first, stride, count,
+			gain * channels[slot].rangeMv / channels[slot].maxValue, dest);
+		break;
+	}
+}
+
+void NetworkController::padRings(quint64 count)
+{
+	if (count > quint64(ring_T.capacity()))
+		count = ring_T.capacity();
+	for (quint64 i = 0; i < count; ++i)
+	{
+		ring_T.push(0);
+		ring_ra.push(0);
+	}
 }
 
 void NetworkController::sendData(QByteArray data)
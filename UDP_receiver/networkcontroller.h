@@ -2,10 +2,13 @@
 #define RECEIVER_H
 
 #include <QVector>
-#include <QQueue>
 #include <QHostAddress>
+#include <atomic>
+#include "samplering.h"
+#include "streamformat.h"
 
 class QUdpSocket;
+class IngestThread;
 
 class NetworkController : public QObject
 {
@@ -13,6 +16,7 @@ class NetworkController : public QObject
 
 public:
     NetworkController();
+    ~NetworkController();
 	QVector<double> T; 
 	QVector<double> T_90; 
 	QVector<double> ra; 
@@ -36,19 +40,45 @@ public:
 	QVector<double> Q_par;
 	QVector<double> I_perp;
 	QVector<double> Q_perp;
-	QQueue<double> q_T;
-	QQueue<double> q_ra;
-	QQueue<double> q_rb;
-	bool updateVectors = 1;
+	SampleRing<DspSample> ring_T;
+	SampleRing<DspSample> ring_ra;
+	std::atomic<bool> updateVectors;
+
+	// called on the ingest thread for every datagram received
+	void processDatagram(const char *data, int size);
+
+	quint64 datagramsReceived() const;
+	quint64 datagramsDropped() const;
+
+	// stream health, as seen from the sequence numbers in the packet headers
+	quint64 packetsLost() const { return lostPackets.load(std::memory_order_relaxed); }
+	quint64 packetsReordered() const { return reorderedPackets.load(std::memory_order_relaxed); }
+	quint64 packetsMalformed() const { return malformedPackets.load(std::memory_order_relaxed); }
+	quint32 streamSampleRate() const { return sampleRate.load(std::memory_order_relaxed); }
 
 public slots:
-    void processPendingDatagrams();
     void sendData(QByteArray data);
 
 private:
     QUdpSocket *udpSocket;
+	IngestThread *ingestThread;
     QHostAddress groupAddress;
-	int packetCount = 0;
+
+	void padRings(quint64 count);
+	void convertChannel(const DOPPLER_PACKET_HEADER &header, const DOPPLER_CHANNEL_HEADER *channels,
+		const char *payload, int slot, double gain, DspSample *dest);
+
+	// ingest thread only
+	bool streamStarted = false;
+	quint32 expectedSequence = 0;
+	quint64 nextSample = 0;
+	QVector<DspSample> scratch_T;
+	QVector<DspSample> scratch_ra;
+
+	std::atomic<quint64> lostPackets;
+	std::atomic<quint64> reorderedPackets;
+	std::atomic<quint64> malformedPackets;
+	std::atomic<quint32> sampleRate;
 };
 
 #endif
@@ -741,7 +741,10 @@ QCPLayer::QCPLayer(QCustomPlot *parentPlot, const QString &layerName) :
   mParentPlot(parentPlot),
   mName(layerName),
   mIndex(-1), // will be set to a proper value by the QCustomPlot layer creation function
-  mVisible(true)
+  mVisible(true),
+  mCached(false),
+  mCacheValid(false),
+  mCacheSignature(0)
 {
   // Note: no need to make sure layerName is unique, because layer
   // management is done with QCustomPlot functions.
@@ -774,6 +777,46 @@ void QCPLayer::setVisible(bool visible)
   mVisible = visible;
 }
 
+/*!
+  Sets whether this layer is drawn from a cached image.
+  
+  A cached layer is rendered into an image of its own, which is then composited onto the plot. On
+  the following replots, the image is reused as long as the layer is not dirty, so in a plot where
+  only the data of the "main" layer changes from frame to frame, the tick labels, grid lines and
+  legend on the other layers are not painted again.
+  
+  A cached layer becomes dirty by itself when the size of the plot, the position of any layout
+  element on it (axis rects, legends, ...), the range, ticks or selection of an axis on it or of the
+  axis a grid on it belongs to, or the visibility or number of its layerables changes. Other
+  changes, such as new pens or fonts, the data of plottables or the position of items on the
+  layer, are not tracked; call \ref markDirty after those. It is therefore best to cache layers
+  that hold axes, grids and legends, and to leave layers with changing plottables and items
+  uncached.
+  
+  Exports (\ref QCustomPlot::savePdf, \ref QCustomPlot::toPixmap, ...) always paint all layers
+  directly.
+*/
+void QCPLayer::setCached(bool enabled)
+{
+  mCached = enabled;
+  if (!mCached)
+    mCache = QImage();
+  mCacheValid = false;
+}
+
+/*!
+  Makes a \ref setCached "cached" layer paint its layerables again at the next replot. Call this
+  after changing properties of layerables on the layer that are not tracked automatically, see
+  \ref setCached.
+  
+  With threaded rendering, this must not be called while a frame is rendered, see \ref
+  QCustomPlot::waitForRender.
+*/
+void QCPLayer::markDirty()
+{
+  mCacheValid = false;
+}
+
 /*! \internal
   
   Adds the \a layerable to the list of this layer. If \a prepend is set to true, the layerable will
@@ -792,6 +835,7 @@ void QCPLayer::addChild(QCPLayerable *layerable, bool prepend)
       mChildren.prepend(layerable);
     else
       mChildren.append(layerable);
+    mCacheValid = false;
   } else
     qDebug() << Q_FUNC_INFO << "layerable is already child of this layer" << reinterpret_cast<quintptr>(layerable);
 }
@@ -809,6 +853,124 @@ void QCPLayer::removeChild(QCPLayerable *layerable)
 {
   if (!mChildren.removeOne(layerable))
     qDebug() << Q_FUNC_INFO << "layerable is not child of this layer" << reinterpret_cast<quintptr>(layerable);
+  mCacheValid = false;
+}
+
+/*! \internal
+  
+  Draws the layerables of this layer with \a painter. If the layer is cached and the painter is not
+  exporting, the layerables are painted into the cache first if it is dirty, and the cache is
+  drawn.
+*/
+void QCPLayer::draw(QCPPainter *painter)
+{
+  if (!mCached || painter->modes().testFlag(QCPPainter::pmVectorized) || painter->modes().testFlag(QCPPainter::pmNoCaching))
+  {
+    drawChildren(painter);
+    return;
+  }
+  
+  const QSize size(painter->device()->width(), painter->device()->height());
+  const quint64 signature = cacheSignature(size);
+  if (!mCacheValid || signature != mCacheSignature || mCache.size() != size)
+  {
+    if (mCache.size() != size)
+      mCache = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    mCache.fill(Qt::transparent);
+    QCPPainter cachePainter(&mCache);
+    cachePainter.setModes(painter->modes());
+    cachePainter.setRenderHints(painter->renderHints());
+    drawChildren(&cachePainter);
+    cachePainter.end();
+    mCacheSignature = signature;
+    mCacheValid = true;
+  }
+  painter->drawImage(0, 0, mCache);
+}
+
+/*! \internal
+  
+  Draws all visible layerables of this layer with \a painter.
+*/
+void QCPLayer::drawChildren(QCPPainter *painter)
+{
+  foreach (QCPLayerable *child, mChildren)
+  {
+    if (child->realVisibility())
+    {
+      painter->save();
+      painter->setClipRect(child->clipRect().translated(0, -1));
+      child->applyDefaultAntialiasingHint(painter);
+      child->draw(painter);
+      painter->restore();
+    }
+  }
+}
+
+/*! \internal
+  
+  Combines \a value into the running hash \a hash (FNV-1a over 64 bit words).
+*/
+static inline void qcpHashCombine(quint64 &hash, quint64 value)
+{
+  hash = (hash ^ value) * Q_UINT64_C(1099511628211);
+}
+
+/*! \internal \overload */
+static inline void qcpHashCombine(quint64 &hash, double value)
+{
+  quint64 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  qcpHashCombine(hash, bits);
+}
+
+/*! \internal \overload */
+static inline void qcpHashCombine(quint64 &hash, const QRect &rect)
+{
+  qcpHashCombine(hash, (quint64(quint32(rect.left())) << 32) | quint32(rect.top()));
+  qcpHashCombine(hash, (quint64(quint32(rect.width())) << 32) | quint32(rect.height()));
+}
+
+/*! \internal
+  
+  Returns a hash of the state the cache of this layer depends on, when painted at \a size pixels.
+  See \ref setCached for what is taken into account.
+*/
+quint64 QCPLayer::cacheSignature(const QSize &size) const
+{
+  quint64 hash = Q_UINT64_C(14695981039346656037);
+  qcpHashCombine(hash, QRect(QPoint(0, 0), size));
+  qcpHashCombine(hash, quint64(mChildren.size()));
+  foreach (QCPLayerable *child, mChildren)
+  {
+    qcpHashCombine(hash, quint64(child->realVisibility()));
+    if (QCPLayoutElement *element = qobject_cast<QCPLayoutElement*>(child))
+    {
+      qcpHashCombine(hash, element->outerRect());
+      if (QCPLegend *legend = qobject_cast<QCPLegend*>(element))
+      {
+        qcpHashCombine(hash, quint64(legend->itemCount()));
+        qcpHashCombine(hash, quint64(legend->selectedParts()));
+      }
+    }
+    // grids follow the ticks of their axis:
+    QCPAxis *axis = qobject_cast<QCPAxis*>(child);
+    if (!axis)
+      axis = qobject_cast<QCPAxis*>(child->parentLayerable());
+    if (axis)
+    {
+      qcpHashCombine(hash, axis->range().lower);
+      qcpHashCombine(hash, axis->range().upper);
+      qcpHashCombine(hash, quint64(axis->selectedParts()));
+      if (axis->axisRect())
+        qcpHashCombine(hash, axis->axisRect()->rect());
+      const QVector<double> ticks = axis->tickVector();
+      qcpHashCombine(hash, quint64(ticks.size()));
+      for (int i=0; i<ticks.size(); ++i)
+        qcpHashCombine(hash, ticks.at(i));
+    }
+  }
+  return hash;
 }
 
 
@@ -4040,7 +4202,8 @@ QCPAxis::QCPAxis(QCPAxisRect *parent, AxisType type) :
   mLowestVisibleTick(0),
   mHighestVisibleTick(-1),
   mCachedMarginValid(false),
-  mCachedMargin(0)
+  mCachedMargin(0),
+  mTickSetupValid(false)
 {
   setParent(parent);
   mGrid->setVisible(false);
@@ -5516,6 +5679,10 @@ void QCPAxis::setupTickVectors()
   if (!mParentPlot) return;
   if ((!mTicks && !mTickLabels && !mGrid->visible()) || mRange.size() <= 0) return;
   
+  // automatic ticks and labels only change when their inputs do, keep them from the last replot otherwise:
+  if (!updateTickSetup())
+    return;
+  
   // fill tick vectors, either by auto generating or by notifying user to fill the vectors himself
   if (mAutoTicks)
   {
@@ -5595,6 +5762,53 @@ void QCPAxis::setupTickVectors()
   }
 }
 
+/*! \internal
+  
+  Compares everything the automatic ticks and tick labels depend on with the state at the last
+  call and stores the current state. Returns false if nothing changed and both ticks and labels
+  are generated automatically, i.e. \ref setupTickVectors would reproduce the current tick
+  vectors. Returns true if they must be set up again.
+*/
+bool QCPAxis::updateTickSetup()
+{
+  TickSetup setup;
+  setup.range = mRange;
+  setup.scaleType = mScaleType;
+  setup.scaleLogBase = mScaleLogBase;
+  setup.tickStep = mAutoTickStep ? 0 : mTickStep; // with auto tick step, mTickStep is an output of generateAutoTicks
+  setup.autoTickCount = mAutoTickStep ? mAutoTickCount : 0;
+  setup.subTickCount = mAutoSubTicks ? -1 : mSubTickCount;
+  setup.tickLabelType = mTickLabelType;
+  setup.numberFormatChar = mNumberFormatChar;
+  setup.numberBeautifulPowers = mNumberBeautifulPowers;
+  setup.numberPrecision = mNumberPrecision;
+  setup.dateTimeFormat = mDateTimeFormat;
+  setup.dateTimeSpec = mDateTimeSpec;
+  setup.locale = mParentPlot->locale();
+  setup.visible = mTicks || mTickLabels || mGrid->visible();
+  
+  const bool unchanged = mTickSetupValid &&
+      setup.range == mTickSetup.range &&
+      setup.scaleType == mTickSetup.scaleType &&
+      setup.scaleLogBase == mTickSetup.scaleLogBase &&
+      setup.tickStep == mTickSetup.tickStep &&
+      setup.autoTickCount == mTickSetup.autoTickCount &&
+      setup.subTickCount == mTickSetup.subTickCount &&
+      setup.tickLabelType == mTickSetup.tickLabelType &&
+      setup.numberFormatChar == mTickSetup.numberFormatChar &&
+      setup.numberBeautifulPowers == mTickSetup.numberBeautifulPowers &&
+      setup.numberPrecision == mTickSetup.numberPrecision &&
+      setup.dateTimeFormat == mTickSetup.dateTimeFormat &&
+      setup.dateTimeSpec == mTickSetup.dateTimeSpec &&
+      setup.locale == mTickSetup.locale &&
+      setup.visible == mTickSetup.visible;
+  
+  // only the fully automatic case can be skipped, otherwise the user is asked via ticksRequest:
+  mTickSetup = setup;
+  mTickSetupValid = mAutoTicks && mAutoTickLabels;
+  return !(unchanged && mTickSetupValid);
+}
+
 /*! \internal
   
   If \ref setAutoTicks is set to true, this function is called by \ref setupTickVectors to
@@ -6383,7 +6597,7 @@ void QCPAxisPainterPrivate::placeTickLabel(QCPPainter *painter, double position,
     case QCPAxis::atTop:    labelAnchor = QPointF(position, axisRect.top()-distanceToAxis-offset); break;
     case QCPAxis::atBottom: labelAnchor = QPointF(position, axisRect.bottom()+distanceToAxis+offset); break;
   }
-  if (mParentPlot->plottingHints().testFlag(QCP::phCacheLabels) && !painter->modes().testFlag(QCPPainter::pmNoCaching)) // label caching enabled
+  if (mParentPlot->plottingHints().testFlag(QCP::phCacheLabels) && !painter->modes().testFlag(QCPPainter::pmNoCaching) && !painter->modes().testFlag(QCPPainter::pmNoPixmaps)) // label caching enabled
   {
     CachedLabel *cachedLabel = mLabelCache.take(text); // attempt to get label from cache
     if (!cachedLabel)  // no cached label existed, create it
@@ -9036,7 +9250,10 @@ QCustomPlot::QCustomPlot(QWidget *parent) :
   mMultiSelectModifier(Qt::ControlModifier),
   mPaintBuffer(size()),
   mMouseEventElement(0),
-  mReplotting(false)
+  mReplotting(false),
+  mRenderThread(0),
+  mReplotPending(false),
+  mRenderRefreshPriority(rpHint)
 {
   setAttribute(Qt::WA_NoMousePropagation);
   setAttribute(Qt::WA_OpaquePaintEvent);
@@ -9088,6 +9305,7 @@ QCustomPlot::QCustomPlot(QWidget *parent) :
 
 QCustomPlot::~QCustomPlot()
 {
+  setThreadedRendering(false);
   clearPlottables();
   clearItems();
 
@@ -9352,6 +9570,45 @@ void QCustomPlot::setMultiSelectModifier(Qt::KeyboardModifier modifier)
   mMultiSelectModifier = modifier;
 }
 
+/*!
+  Sets whether \ref replot paints the plot on a background thread.
+  
+  By default, a replot paints all layers into the widget's paint buffer on the GUI thread, which
+  blocks input handling and other slots for the duration of the replot. If \a enabled is true,
+  \ref replot only starts painting the plot into a QImage on a render thread and returns right
+  away; once the frame is finished, it is shown on the widget and \ref afterReplot is emitted.
+  
+  A replot that is requested while a frame is still being rendered is not queued behind it.
+  Instead, all such requests are coalesced into a single replot that starts when the current frame
+  is finished, and shows the state of the plot at that time.
+  
+  While a frame is rendered, the render thread reads the plot's layout, axes, plottables and items,
+  so they must not be modified. Use \ref isRendering to skip an update while a frame is in flight,
+  or call \ref waitForRender before changing the plot. QCustomPlot does the latter in its own
+  event handlers (mouse interactions, resizing) and exports.
+  
+  On the render thread, the painter has the \ref QCPPainter::pmNoPixmaps mode set, so no
+  QPixmaps are created; tick labels are not cached as pixmaps in that mode, but the layers holding
+  the axes can be cached as a whole, see \ref QCPLayer::setCached. Background and scatter pixmaps
+  should not be used with threaded rendering.
+*/
+void QCustomPlot::setThreadedRendering(bool enabled)
+{
+  if (enabled == (mRenderThread != 0))
+    return;
+  if (enabled)
+  {
+    mRenderThread = new QCPRenderThread(this);
+    mRenderThread->start();
+  } else
+  {
+    delete mRenderThread; // finishes a frame in flight
+    mRenderThread = 0;
+    mRenderedFrame = QImage();
+    mReplotPending = false;
+  }
+}
+
 /*!
   Sets the viewport of this QCustomPlot. The Viewport is the area that the top level layout
   (QCustomPlot::plotLayout()) uses as its rect. Normally, the viewport is the entire widget rect.
@@ -10347,6 +10604,7 @@ void QCustomPlot::deselectAll()
   {
     foreach (QCPLayerable *layerable, layer->children())
       layerable->deselectEvent(0);
+    layer->markDirty();
   }
 }
 
@@ -10367,6 +10625,23 @@ void QCustomPlot::replot(QCustomPlot::RefreshPriority refreshPriority)
 {
   if (mReplotting) // incase signals loop back to replot slot
     return;
+  if (mRenderThread)
+  {
+    if (mRenderThread->isBusy()) // coalesce with other requests until the frame in flight is shown
+    {
+      mReplotPending = true;
+      if (refreshPriority == rpImmediate)
+        mRenderRefreshPriority = rpImmediate;
+      return;
+    }
+    mReplotting = true;
+    emit beforeReplot();
+    mRenderRefreshPriority = refreshPriority;
+    updateLayout();
+    mRenderThread->render(size());
+    mReplotting = false;
+    return;
+  }
   mReplotting = true;
   emit beforeReplot();
   
@@ -10380,10 +10655,7 @@ void QCustomPlot::replot(QCustomPlot::RefreshPriority refreshPriority)
       painter.fillRect(mViewport, mBackgroundBrush);
     draw(&painter);
     painter.end();
-    if ((refreshPriority == rpHint && mPlottingHints.testFlag(QCP::phForceRepaint)) || refreshPriority==rpImmediate)
-      repaint();
-    else
-      update();
+    refresh(refreshPriority);
   } else // might happen if QCustomPlot has width or height zero
     qDebug() << Q_FUNC_INFO << "Couldn't activate painter on buffer. This usually happens because QCustomPlot has width or height zero.";
   
@@ -10391,6 +10663,32 @@ void QCustomPlot::replot(QCustomPlot::RefreshPriority refreshPriority)
   mReplotting = false;
 }
 
+/*!
+  Returns true while a frame requested by \ref replot is being rendered on the render thread and
+  has not been shown on the widget yet. A further \ref replot in that time is coalesced with
+  others and performed once the frame is shown. Always returns false if threaded rendering is
+  disabled.
+  
+  \see setThreadedRendering, waitForRender
+*/
+bool QCustomPlot::isRendering() const
+{
+  return mRenderThread && mRenderThread->isBusy();
+}
+
+/*!
+  Blocks until the render thread has finished painting the current frame, if any. Afterwards, the
+  plot may be modified until the next \ref replot. Returns immediately if threaded rendering is
+  disabled.
+  
+  \see setThreadedRendering, isRendering
+*/
+void QCustomPlot::waitForRender()
+{
+  if (mRenderThread)
+    mRenderThread->waitForPainting();
+}
+
 /*!
   Rescales the axes such that all plottables (like graphs) in the plot are fully visible.
   
@@ -10448,6 +10746,7 @@ void QCustomPlot::rescaleAxes(bool onlyVisiblePlottables)
 */
 bool QCustomPlot::savePdf(const QString &fileName, bool noCosmeticPen, int width, int height, const QString &pdfCreator, const QString &pdfTitle)
 {
+  waitForRender();
   bool success = false;
 #ifdef QT_NO_PRINTER
   Q_UNUSED(fileName)
@@ -10658,7 +10957,10 @@ void QCustomPlot::paintEvent(QPaintEvent *event)
 {
   Q_UNUSED(event);
   QPainter painter(this);
-  painter.drawPixmap(0, 0, mPaintBuffer);
+  if (mRenderThread)
+    painter.drawImage(0, 0, mRenderedFrame);
+  else
+    painter.drawPixmap(0, 0, mPaintBuffer);
 }
 
 /*! \internal
@@ -10670,6 +10972,7 @@ void QCustomPlot::paintEvent(QPaintEvent *event)
 void QCustomPlot::resizeEvent(QResizeEvent *event)
 {
   // resize and repaint the buffer:
+  waitForRender();
   mPaintBuffer = QPixmap(event->size());
   setViewport(rect());
   replot(rpQueued); // queued update is important here, to prevent painting issues in some contexts
@@ -10686,6 +10989,7 @@ void QCustomPlot::resizeEvent(QResizeEvent *event)
 */
 void QCustomPlot::mouseDoubleClickEvent(QMouseEvent *event)
 {
+  waitForRender();
   emit mouseDoubleClick(event);
   
   QVariant details;
@@ -10728,6 +11032,7 @@ void QCustomPlot::mouseDoubleClickEvent(QMouseEvent *event)
 */
 void QCustomPlot::mousePressEvent(QMouseEvent *event)
 {
+  waitForRender();
   emit mousePress(event);
   mMousePressPos = event->pos(); // need this to determine in releaseEvent whether it was a click (no position change between press and release)
   
@@ -10750,6 +11055,7 @@ void QCustomPlot::mousePressEvent(QMouseEvent *event)
 */
 void QCustomPlot::mouseMoveEvent(QMouseEvent *event)
 {
+  waitForRender();
   emit mouseMove(event);
 
   // call event of affected layout element:
@@ -10775,6 +11081,7 @@ void QCustomPlot::mouseMoveEvent(QMouseEvent *event)
 */
 void QCustomPlot::mouseReleaseEvent(QMouseEvent *event)
 {
+  waitForRender();
   emit mouseRelease(event);
   bool doReplot = false;
   
@@ -10813,6 +11120,9 @@ void QCustomPlot::mouseReleaseEvent(QMouseEvent *event)
       if (selectionStateChanged)
       {
         doReplot = true;
+        // selection changes the pens and fonts of layerables, which cached layers don't track:
+        foreach (QCPLayer *layer, mLayers)
+          layer->markDirty();
         emit selectionChangedByUser();
       }
     }
@@ -10855,6 +11165,7 @@ void QCustomPlot::mouseReleaseEvent(QMouseEvent *event)
 */
 void QCustomPlot::wheelEvent(QWheelEvent *event)
 {
+  waitForRender();
   emit mouseWheel(event);
   
   // call event of affected layout element:
@@ -10873,29 +11184,36 @@ void QCustomPlot::wheelEvent(QWheelEvent *event)
 */
 void QCustomPlot::draw(QCPPainter *painter)
 {
-  // run through layout phases:
+  updateLayout();
+  drawLayers(painter);
+}
+
+/*! \internal
+  
+  Runs through the layout phases, which also sets up the axis ticks. This is the part of \ref draw
+  that changes the state of the plot, so with threaded rendering, \ref replot does it on the GUI
+  thread before the render thread calls \ref drawLayers.
+*/
+void QCustomPlot::updateLayout()
+{
   mPlotLayout->update(QCPLayoutElement::upPreparation);
   mPlotLayout->update(QCPLayoutElement::upMargins);
   mPlotLayout->update(QCPLayoutElement::upLayout);
+}
+
+/*! \internal
   
+  Draws the background pixmap and all layers with the specified \a painter, using the layout
+  computed by the last \ref updateLayout.
+*/
+void QCustomPlot::drawLayers(QCPPainter *painter)
+{
   // draw viewport background pixmap:
   drawBackground(painter);
 
-  // draw all layered objects (grid, axes, plottables, items, legend,...):
+  // draw all layered objects (grid, axes, plottables, items, legend,...), cached layers from their images:
   foreach (QCPLayer *layer, mLayers)
-  {
-    foreach (QCPLayerable *child, layer->children())
-    {
-      if (child->realVisibility())
-      {
-        painter->save();
-        painter->setClipRect(child->clipRect().translated(0, -1));
-        child->applyDefaultAntialiasingHint(painter);
-        child->draw(painter);
-        painter->restore();
-      }
-    }
-  }
+    layer->draw(painter);
   
   /* Debug code to draw all layout element rects
   foreach (QCPLayoutElement* el, findChildren<QCPLayoutElement*>())
@@ -11060,6 +11378,7 @@ bool QCustomPlot::saveRastered(const QString &fileName, int width, int height, d
 QPixmap QCustomPlot::toPixmap(int width, int height, double scale)
 {
   // this method is somewhat similar to toPainter. Change something here, and a change in toPainter might be necessary, too.
+  waitForRender();
   int newWidth, newHeight;
   if (width == 0 || height == 0)
   {
@@ -11116,6 +11435,7 @@ QPixmap QCustomPlot::toPixmap(int width, int height, double scale)
 void QCustomPlot::toPainter(QCPPainter *painter, int width, int height)
 {
   // this method is somewhat similar to toPixmap. Change something here, and a change in toPixmap might be necessary, too.
+  waitForRender();
   int newWidth, newHeight;
   if (width == 0 || height == 0)
   {
@@ -11141,6 +11461,168 @@ void QCustomPlot::toPainter(QCPPainter *painter, int width, int height)
 }
 
 
+/*! \internal
+  
+  Brings the painted frame onto the widget surface, either right away or with the next paint
+  event, depending on \a refreshPriority.
+*/
+void QCustomPlot::refresh(RefreshPriority refreshPriority)
+{
+  if ((refreshPriority == rpHint && mPlottingHints.testFlag(QCP::phForceRepaint)) || refreshPriority==rpImmediate)
+    repaint();
+  else
+    update();
+}
+
+/*! \internal
+  
+  Called on the GUI thread when the render thread has finished a frame. Shows the frame on the
+  widget, emits \ref afterReplot and starts the replot that was coalesced while the frame was in
+  flight, if any.
+*/
+void QCustomPlot::renderFinished()
+{
+  if (!mRenderThread)
+    return;
+  mRenderThread->takeFrame(mRenderedFrame);
+  refresh(mRenderRefreshPriority);
+  
+  mReplotting = true; // incase signals loop back to replot slot
+  emit afterReplot();
+  mReplotting = false;
+  
+  if (mReplotPending)
+  {
+    mReplotPending = false;
+    replot(mRenderRefreshPriority);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPRenderThread
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*! \class QCPRenderThread
+  \brief The thread that paints the frames of a QCustomPlot with threaded rendering enabled
+  
+  This class is used internally by QCustomPlot, see \ref QCustomPlot::setThreadedRendering.
+  
+  The thread paints one frame at a time into a QImage. A frame is requested with \ref render and
+  handed to the GUI thread with \ref takeFrame, after the thread has invoked
+  QCustomPlot::renderFinished through the event loop. In between, the thread counts as busy, so
+  the plot coalesces further replots instead of queueing them. The two images are swapped rather
+  than copied, so after the first frames no memory is allocated unless the widget is resized.
+*/
+
+/*!
+  Creates a render thread for \a parentPlot. The thread must be started with QThread::start.
+*/
+QCPRenderThread::QCPRenderThread(QCustomPlot *parentPlot) :
+  mParentPlot(parentPlot),
+  mBusy(false),
+  mPainting(false),
+  mStop(false)
+{
+}
+
+/*!
+  Finishes the frame in flight, if any, and stops the thread.
+*/
+QCPRenderThread::~QCPRenderThread()
+{
+  mMutex.lock();
+  mStop = true;
+  mRequested.wakeAll();
+  mMutex.unlock();
+  wait();
+}
+
+/*!
+  Returns true from a call to \ref render until the finished frame was taken with \ref takeFrame.
+*/
+bool QCPRenderThread::isBusy() const
+{
+  QMutexLocker locker(&mMutex);
+  return mBusy;
+}
+
+/*!
+  Requests a frame of \a size pixels. Must not be called while the thread is busy.
+*/
+void QCPRenderThread::render(const QSize &size)
+{
+  QMutexLocker locker(&mMutex);
+  mSize = size;
+  mBusy = true;
+  mPainting = true;
+  mRequested.wakeAll();
+}
+
+/*!
+  Blocks until the frame in flight, if any, is painted.
+*/
+void QCPRenderThread::waitForPainting()
+{
+  QMutexLocker locker(&mMutex);
+  while (mPainting)
+    mPainted.wait(&mMutex);
+}
+
+/*!
+  Swaps the finished frame into \a frame and ends the busy state. The previous contents of \a frame
+  are painted over by the next frame.
+*/
+void QCPRenderThread::takeFrame(QImage &frame)
+{
+  QMutexLocker locker(&mMutex);
+  if (!mBusy || mPainting)
+    return;
+  frame.swap(mFrame);
+  mBusy = false;
+}
+
+/*! \internal
+  
+  Waits for frame requests and paints them. The painting mirrors QCustomPlot::replot, but uses a
+  QImage and the \ref QCPPainter::pmNoPixmaps mode, since QPixmaps may only be used on the GUI
+  thread. The layout phases, which may touch the widget, have already run on the GUI thread.
+*/
+void QCPRenderThread::run()
+{
+  QMutexLocker locker(&mMutex);
+  forever
+  {
+    while (!mPainting && !mStop)
+      mRequested.wait(&mMutex);
+    if (mStop)
+      break;
+    const QSize size = mSize;
+    locker.unlock();
+    
+    if (mFrame.size() != size)
+      mFrame = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    const QBrush &backgroundBrush = mParentPlot->mBackgroundBrush;
+    mFrame.fill(backgroundBrush.style() == Qt::SolidPattern ? backgroundBrush.color() : QColor(Qt::transparent));
+    QCPPainter painter;
+    if (!mFrame.isNull() && painter.begin(&mFrame))
+    {
+      painter.setMode(QCPPainter::pmNoPixmaps);
+      painter.setRenderHint(QPainter::HighQualityAntialiasing);
+      if (backgroundBrush.style() != Qt::SolidPattern && backgroundBrush.style() != Qt::NoBrush)
+        painter.fillRect(mParentPlot->mViewport, backgroundBrush);
+      mParentPlot->drawLayers(&painter); // the layout was updated by QCustomPlot::replot
+      painter.end();
+    }
+    
+    locker.relock();
+    mPainting = false;
+    mPainted.wakeAll();
+    QMetaObject::invokeMethod(mParentPlot, "renderFinished", Qt::QueuedConnection);
+  }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////// QCPColorGradient
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -11306,6 +11788,9 @@ void QCPColorGradient::colorize(const double *data, const QCPRange &range, QRgb
   if (mColorBufferInvalidated)
     updateColorBuffer();
   
+  // this is called once per image line on every map update, so keep everything that doesn't depend
+  // on the data value out of the loops:
+  const QRgb *colors = mColorBuffer.constData();
   if (!logarithmic)
   {
     const double posToIndexFactor = (mLevelCount-1)/range.size();
@@ -11316,7 +11801,7 @@ void QCPColorGradient::colorize(const double *data, const QCPRange &range, QRgb
         int index = (int)((data[dataIndexFactor*i]-range.lower)*posToIndexFactor) % mLevelCount;
         if (index < 0)
           index += mLevelCount;
-        scanLine[i] = mColorBuffer.at(index);
+        scanLine[i] = colors[index];
       }
     } else
     {
@@ -11327,30 +11812,32 @@ void QCPColorGradient::colorize(const double *data, const QCPRange &range, QRgb
           index = 0;
         else if (index >= mLevelCount)
           index = mLevelCount-1;
-        scanLine[i] = mColorBuffer.at(index);
+        scanLine[i] = colors[index];
       }
     }
   } else // logarithmic == true
   {
+    const double logPosToIndexFactor = (mLevelCount-1)/qLn(range.upper/range.lower);
+    const double inverseLower = 1.0/range.lower;
     if (mPeriodic)
     {
       for (int i=0; i<n; ++i)
       {
-        int index = (int)(qLn(data[dataIndexFactor*i]/range.lower)/qLn(range.upper/range.lower)*(mLevelCount-1)) % mLevelCount;
+        int index = (int)(qLn(data[dataIndexFactor*i]*inverseLower)*logPosToIndexFactor) % mLevelCount;
         if (index < 0)
           index += mLevelCount;
-        scanLine[i] = mColorBuffer.at(index);
+        scanLine[i] = colors[index];
       }
     } else
     {
       for (int i=0; i<n; ++i)
       {
-        int index = qLn(data[dataIndexFactor*i]/range.lower)/qLn(range.upper/range.lower)*(mLevelCount-1);
+        int index = qLn(data[dataIndexFactor*i]*inverseLower)*logPosToIndexFactor;
         if (index < 0)
           index = 0;
         else if (index >= mLevelCount)
           index = mLevelCount-1;
-        scanLine[i] = mColorBuffer.at(index);
+        scanLine[i] = colors[index];
       }
     }
   }
@@ -14376,7 +14863,7 @@ void QCPColorScaleAxisRectPrivate::axisSelectableChanged(QCPAxis::SelectablePart
 /*! \class QCPData
   \brief Holds the data of one single data point for QCPGraph.
   
-  The container for storing multiple data points is \ref QCPDataMap.
+  The container for storing multiple data points is \ref QCPDataMap, a \ref QCPDataContainer.
   
   The stored data is:
   \li \a key: coordinate on the key axis of this data point
@@ -14417,73 +14904,526 @@ QCPData::QCPData(double key, double value) :
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////// QCPGraph
+//////////////////// QCPDataContainer
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-/*! \class QCPGraph
-  \brief A plottable representing a graph in a plot.
-
-  \image html QCPGraph.png
-  
-  Usually you create new graphs by calling QCustomPlot::addGraph. The resulting instance can be
-  accessed via QCustomPlot::graph.
-
-  To plot data, assign it with the \ref setData or \ref addData functions. Alternatively, you can
-  also access and modify the graph's data via the \ref data method, which returns a pointer to the
-  internal \ref QCPDataMap.
-  
-  Graphs are used to display single-valued data. Single-valued means that there should only be one
-  data point per unique key coordinate. In other words, the graph can't have \a loops. If you do
-  want to plot non-single-valued curves, rather use the QCPCurve plottable.
-  
-  Gaps in the graph line can be created by adding data points with NaN as value
-  (<tt>qQNaN()</tt> or <tt>std::numeric_limits<double>::quiet_NaN()</tt>) in between the two data points that shall be
-  separated.
-  
-  \section appearance Changing the appearance
+/*! \class QCPDataContainer
+  \brief Sorted, contiguous storage for the data points of a QCPGraph.
   
-  The appearance of the graph is mainly determined by the line style, scatter style, brush and pen
-  of the graph (\ref setLineStyle, \ref setScatterStyle, \ref setBrush, \ref setPen).
-  
-  \subsection filling Filling under or between graphs
+  The data points are kept in one QVector<QCPData>, ordered by key. Points with equal keys keep
+  the order in which they were inserted. Compared to a QMap this costs no heap node per point,
+  finding the visible range is a binary search over contiguous memory, and whole datasets can be
+  replaced or appended in O(n).
   
-  QCPGraph knows two types of fills: Normal graph fills towards the zero-value-line parallel to
-  the key axis of the graph, and fills between two graphs, called channel fills. To enable a fill,
-  just set a brush with \ref setBrush which is neither Qt::NoBrush nor fully transparent.
+  The container offers the subset of the QMap interface QCustomPlot uses (\ref insertMulti,
+  \ref lowerBound, \ref upperBound, \ref erase, iterators with \a key() and \a value(), ...),
+  so code written against the former QMap based \ref QCPDataMap keeps working. Inserting single
+  points is O(1) if they are appended at the end, and O(n) anywhere else; for bulk updates use
+  \ref set, \ref add or \ref adopt.
   
-  By default, a normal fill towards the zero-value-line will be drawn. To set up a channel fill
-  between this graph and another one, call \ref setChannelFillGraph with the other graph as
-  parameter.
-
-  \see QCustomPlot::addGraph, QCustomPlot::graph
+  The container tracks how many leading points are unchanged (\ref unchangedPrefix), so a
+  QCPMinMaxPyramid over it only recomputes what changed. Points may be changed through a mutable
+  iterator: \ref begin and \ref end count every point as changed, and \ref lowerBound and \ref
+  upperBound every point from the one they return on. Read through \ref constBegin, \ref
+  constEnd or a const container to keep the tracking.
 */
 
-/* start of documentation of inline functions */
-
-/*! \fn QCPDataMap *QCPGraph::data() const
-  
-  Returns a pointer to the internal data storage of type \ref QCPDataMap. You may use it to
-  directly manipulate the data, which may be more convenient and faster than using the regular \ref
-  setData or \ref addData methods, in certain situations.
-*/
+namespace {
+bool qcpDataKeyLess(const QCPData &a, const QCPData &b) { return a.key < b.key; }
+bool qcpDataLessThanKey(const QCPData &a, double key) { return a.key < key; }
+bool qcpKeyLessThanData(double key, const QCPData &b) { return key < b.key; }
+}
 
-/* end of documentation of inline functions */
+QCPDataContainer::QCPDataContainer() :
+  mUnchangedPrefix(0)
+{
+}
 
 /*!
-  Constructs a graph which uses \a keyAxis as its key axis ("x") and \a valueAxis as its value
-  axis ("y"). \a keyAxis and \a valueAxis must reside in the same QCustomPlot instance and not have
-  the same orientation. If either of these restrictions is violated, a corresponding message is
-  printed to the debug output (qDebug), the construction is not aborted, though.
-  
-  The constructed QCPGraph can be added to the plot with QCustomPlot::addPlottable, QCustomPlot
-  then takes ownership of the graph.
-  
-  To directly create a graph inside a plot, you can also use the simpler QCustomPlot::addGraph function.
+  Returns an iterator to the first data point with a key not smaller than \a key, or \ref end if
+  there is none. This is a binary search. The point returned and all after it count as changed.
 */
-QCPGraph::QCPGraph(QCPAxis *keyAxis, QCPAxis *valueAxis) :
-  QCPAbstractPlottable(keyAxis, valueAxis)
+QCPDataContainer::iterator QCPDataContainer::lowerBound(double key)
 {
-  mData = new QCPDataMap;
+  QCPData *first = mData.data();
+  QCPData *bound = std::lower_bound(first, first+mData.size(), key, qcpDataLessThanKey);
+  mUnchangedPrefix = qMin(mUnchangedPrefix, int(bound-first));
+  return iterator(bound);
+}
+
+/*!
+  Returns an iterator to the first data point with a key greater than \a key, or \ref end if
+  there is none. This is a binary search. The point returned and all after it count as changed.
+*/
+QCPDataContainer::iterator QCPDataContainer::upperBound(double key)
+{
+  QCPData *first = mData.data();
+  QCPData *bound = std::upper_bound(first, first+mData.size(), key, qcpKeyLessThanData);
+  mUnchangedPrefix = qMin(mUnchangedPrefix, int(bound-first));
+  return iterator(bound);
+}
+
+/*! \overload */
+QCPDataContainer::const_iterator QCPDataContainer::lowerBound(double key) const
+{
+  return const_iterator(std::lower_bound(mData.constData(), mData.constData()+mData.size(), key, qcpDataLessThanKey));
+}
+
+/*! \overload */
+QCPDataContainer::const_iterator QCPDataContainer::upperBound(double key) const
+{
+  return const_iterator(std::upper_bound(mData.constData(), mData.constData()+mData.size(), key, qcpKeyLessThanData));
+}
+
+/*!
+  Inserts \a data at the position of \a key, after any points with an equal key. The key stored
+  in \a data is replaced by \a key. Appending (a key not smaller than the last one) is O(1).
+*/
+QCPDataContainer::iterator QCPDataContainer::insertMulti(double key, const QCPData &data)
+{
+  int index = mData.size();
+  if (!mData.isEmpty() && key < mData.last().key)
+    index = int(std::upper_bound(mData.constData(), mData.constData()+mData.size(), key, qcpKeyLessThanData)-mData.constData());
+  mUnchangedPrefix = qMin(mUnchangedPrefix, index);
+  mData.insert(index, data);
+  mData[index].key = key;
+  return iterator(mData.data()+index);
+}
+
+/*!
+  Adds all data points of \a other. If they all lie after the current points this is a plain
+  append, otherwise the two sorted sequences are merged in O(n).
+*/
+void QCPDataContainer::unite(const QCPDataContainer &other)
+{
+  const int oldSize = mData.size();
+  mData += other.mData;
+  sort(oldSize);
+}
+
+/*!
+  Removes the data point at \a it and returns an iterator to the point after it.
+*/
+QCPDataContainer::iterator QCPDataContainer::erase(iterator it)
+{
+  return erase(it, it+1);
+}
+
+/*! \overload
+  Removes the data points from \a first up to, but not including, \a last in one go and returns
+  an iterator to the point after the removed range.
+*/
+QCPDataContainer::iterator QCPDataContainer::erase(iterator first, iterator last)
+{
+  const int index = int(first.d-mData.data());
+  const int count = last-first;
+  mUnchangedPrefix = qMin(mUnchangedPrefix, index);
+  mData.remove(index, count);
+  return iterator(mData.data()+index);
+}
+
+/*!
+  Removes all data points with a key equal to \a key and returns how many were removed.
+*/
+int QCPDataContainer::remove(double key)
+{
+  iterator first = lowerBound(key);
+  iterator last = upperBound(key);
+  const int count = last-first;
+  erase(first, last);
+  return count;
+}
+
+/*!
+  Replaces the data with the points given by the \a keys and \a values pairs. If both vectors
+  don't have the same size, the smaller size is used. The storage is reused if it is large
+  enough, and sorting is skipped if the keys are already ascending, so the common case costs one
+  linear pass.
+  
+  Leading points that keep their key and value count as unchanged for \ref unchangedPrefix, so
+  setting data that only grew at the end does not invalidate a QCPMinMaxPyramid built over it.
+*/
+void QCPDataContainer::set(const QVector<double> &keys, const QVector<double> &values)
+{
+  const int n = qMin(keys.size(), values.size());
+  int unchanged = 0;
+  const int common = qMin(mUnchangedPrefix, n);
+  while (unchanged < common && mData.at(unchanged).key == keys.at(unchanged) && mData.at(unchanged).value == values.at(unchanged))
+    ++unchanged;
+  
+  mData.resize(0);
+  add(keys, values);
+  
+  // sorting may have moved other points in front
+  int kept = 0;
+  while (kept < unchanged && mData.at(kept).key == keys.at(kept) && mData.at(kept).value == values.at(kept))
+    ++kept;
+  mUnchangedPrefix = kept;
+}
+
+/*!
+  Adds the points given by the \a keys and \a values pairs. If both vectors don't have the same
+  size, the smaller size is used. Points that are ascending and lie after the current points are
+  appended in O(n); anything else is sorted (or merged) into place.
+*/
+void QCPDataContainer::add(const QVector<double> &keys, const QVector<double> &values)
+{
+  const int n = qMin(keys.size(), values.size());
+  const int oldSize = mData.size();
+  mData.resize(oldSize+n);
+  QCPData *dest = mData.data()+oldSize;
+  const double *key = keys.constData();
+  const double *value = values.constData();
+  for (int i=0; i<n; ++i)
+  {
+    dest[i].key = key[i];
+    dest[i].value = value[i];
+    dest[i].keyErrorPlus = 0;
+    dest[i].keyErrorMinus = 0;
+    dest[i].valueErrorPlus = 0;
+    dest[i].valueErrorMinus = 0;
+  }
+  sort(oldSize);
+}
+
+/*!
+  Replaces the data with \a data without copying it: the two vectors are swapped, so afterwards
+  \a data holds the previous contents of the container. A caller that adopts a buffer every frame
+  thus gets the buffer it adopted last time back to fill again, and no allocation or copy takes
+  place at all.
+  
+  If \a alreadySorted is false, the points are sorted by key (which is skipped if they already
+  are). If it is true, the caller guarantees ascending keys and nothing is checked.
+*/
+void QCPDataContainer::adopt(QVector<QCPData> &data, bool alreadySorted)
+{
+  mData.swap(data);
+  mUnchangedPrefix = 0;
+  if (!alreadySorted)
+    sort(0);
+}
+
+/*! \internal
+  
+  Restores the key order after points were appended. The first \a sortedPrefix points are known
+  to be sorted already. If the appended points are ascending and start after the prefix, nothing
+  needs to be done; otherwise they are sorted and merged with the prefix. Both steps are stable.
+*/
+void QCPDataContainer::sort(int sortedPrefix)
+{
+  QCPData *first = mData.data();
+  QCPData *middle = first+sortedPrefix;
+  QCPData *last = first+mData.size();
+  if (middle == last)
+    return;
+  
+  // common case: ascending points appended at the end
+  bool sorted = true;
+  for (QCPData *it = middle+1; it < last; ++it)
+  {
+    if (it->key < (it-1)->key)
+    {
+      sorted = false;
+      break;
+    }
+  }
+  if (!sorted)
+    std::stable_sort(middle, last, qcpDataKeyLess);
+  if (middle != first && middle->key < (middle-1)->key)
+  {
+    // points from the first one greater than the smallest appended key on move
+    mUnchangedPrefix = qMin(mUnchangedPrefix, int(std::upper_bound(first, middle, *middle, qcpDataKeyLess)-first));
+    std::inplace_merge(first, middle, last, qcpDataKeyLess);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPMinMaxPyramid
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*! \class QCPMinMaxPyramid
+  \brief Multi-resolution min/max summary of a sequence of values.
+  
+  Level \a L divides the values into consecutive buckets of \ref bucketSize (\a L) = 2^(L+1)
+  values and stores, for every bucket, its smallest and largest value and where in the bucket they
+  are. Each level is built from the one below, so the whole pyramid takes about one bucket per
+  value. NaN values are only picked when a bucket has no other values.
+  
+  The values are addressed by an absolute index, and bucket \a b of a level covers the indices
+  from b*bucketSize on. Each level keeps the buckets of a window of indices, a power of two, and
+  stores bucket \a b at slot \a b modulo the number of buckets in the window. This lets the
+  pyramid summarize the data of a QCPGraph, whose window grows with the data, as well as a ring
+  buffer, whose window is its capacity and which wraps around together with the pyramid.
+  
+  Updates are incremental: only the buckets covering values that were appended or changed since
+  the previous update are recomputed, so when samples are streamed onto the end of a graph or a
+  ring, the cost of an update follows the number of new samples, not the size of the data.
+  
+  QCPGraph uses this to draw large datasets in time proportional to the plot width, see \ref
+  QCPGraph::setMinMaxPyramid, and QCPStreamGraph for every replot of its ring buffer.
+*/
+
+namespace {
+struct QCPDataValueAt
+{
+  const QCPData *data;
+  double operator()(quint64 index) const { return data[index].value; }
+};
+
+template <typename Sample>
+struct QCPRingValueAt
+{
+  const Sample *ring;
+  quint64 mask;
+  double operator()(quint64 index) const { return ring[index & mask]; }
+};
+}
+
+QCPMinMaxPyramid::QCPMinMaxPyramid() :
+  mWindow(0),
+  mEnd(0)
+{
+}
+
+/*!
+  Returns bucket number \a index of \a level, i.e. the one covering the values from index*\ref
+  bucketSize (\a level) on. Only the buckets within the window of the last update are valid.
+*/
+const QCPMinMaxPyramid::Bucket &QCPMinMaxPyramid::bucket(int level, quint64 index) const
+{
+  const QVector<Bucket> &buckets = mLevels.at(level);
+  return buckets.at(int(index & quint64(buckets.size()-1)));
+}
+
+/*!
+  Returns the highest level whose buckets hold at most \a pointsPerBucket points, or -1 if even
+  the buckets of level 0 are larger.
+*/
+int QCPMinMaxPyramid::levelFor(double pointsPerBucket) const
+{
+  int level = -1;
+  while (level+1 < mLevels.size() && bucketSize(level+1) <= pointsPerBucket)
+    ++level;
+  return level;
+}
+
+/*!
+  Marks every bucket as outdated, so the next update recomputes the pyramid completely. The
+  storage is kept for that.
+*/
+void QCPMinMaxPyramid::clear()
+{
+  mEnd = 0;
+}
+
+/*!
+  Brings the pyramid up to date with the values of \a data and resets the change tracking of \a
+  data. Points that were appended or changed since the last call are picked up, see \ref
+  QCPDataContainer::unchangedPrefix.
+*/
+void QCPMinMaxPyramid::update(const QCPDataContainer &data)
+{
+  const quint64 count = data.size();
+  int window = qMax(mWindow, 2);
+  while (quint64(window) < count)
+    window *= 2;
+  if (window != mWindow)
+    setWindow(window);
+  
+  const quint64 from = qMin(quint64(data.unchangedPrefix()), mEnd);
+  const QCPDataValueAt valueAt = {data.vector().constData()};
+  updateBuckets(valueAt, 0, count, from);
+  mEnd = count;
+  const_cast<QCPDataContainer&>(data).resetUnchangedPrefix();
+}
+
+/*! \overload
+  
+  Brings the pyramid up to date with the samples of the ring buffer \a ring of \a capacity
+  samples (a power of two), where sample \a i is stored at <tt>ring[i & (capacity-1)]</tt>. Only
+  the samples in [\a begin, \a end) are looked at; the buckets covering samples appended since
+  the previous call are recomputed.
+*/
+void QCPMinMaxPyramid::update(const double *ring, int capacity, quint64 begin, quint64 end)
+{
+  const QCPRingValueAt<double> valueAt = {ring, quint64(capacity-1)};
+  updateBuckets(valueAt, begin, end, prepareRing(capacity, begin, end));
+  mEnd = end;
+}
+
+/*! \overload */
+void QCPMinMaxPyramid::update(const float *ring, int capacity, quint64 begin, quint64 end)
+{
+  const QCPRingValueAt<float> valueAt = {ring, quint64(capacity-1)};
+  updateBuckets(valueAt, begin, end, prepareRing(capacity, begin, end));
+  mEnd = end;
+}
+
+/*! \internal
+  
+  Allocates the levels for a window of \a window indices, a power of two. The top level holds a
+  single bucket spanning the whole window. All buckets are outdated afterwards.
+*/
+void QCPMinMaxPyramid::setWindow(int window)
+{
+  mLevels.clear();
+  for (int size=2; size<=window; size *= 2)
+    mLevels.append(QVector<Bucket>(window/size));
+  mWindow = window;
+  mEnd = 0;
+}
+
+/*! \internal
+  
+  Adapts the window to a ring buffer of \a capacity samples and returns the first index whose
+  buckets need to be recomputed for the samples in [\a begin, \a end).
+*/
+quint64 QCPMinMaxPyramid::prepareRing(int capacity, quint64 begin, quint64 end)
+{
+  if (capacity != mWindow)
+    setWindow(capacity);
+  if (mEnd > end) // the ring was restarted
+    return begin;
+  return qMax(mEnd, begin);
+}
+
+/*! \internal
+  
+  Recomputes, on every level, the buckets that cover the indices from \a from up to \a end. Only
+  the values in [\a begin, \a end) are read, through \a valueAt (index); values before \a begin
+  may already be gone from a ring buffer.
+*/
+template <class ValueAt>
+void QCPMinMaxPyramid::updateBuckets(const ValueAt &valueAt, quint64 begin, quint64 end, quint64 from)
+{
+  for (int level=0; level<mLevels.size() && from < end; ++level)
+  {
+    const quint64 size = quint64(2)<<level;
+    const quint64 half = size/2;
+    Bucket *buckets = mLevels[level].data();
+    const quint64 slotMask = mLevels.at(level).size()-1;
+    const Bucket *lower = level > 0 ? mLevels.at(level-1).constData() : 0;
+    const quint64 lowerMask = level > 0 ? mLevels.at(level-1).size()-1 : 0;
+    for (quint64 b=from/size; b*size<end; ++b)
+    {
+      Bucket &bucket = buckets[b & slotMask];
+      if (level == 0)
+      {
+        const quint64 first = qMax(b*size, begin);
+        const quint64 last = qMin(b*size+size, end);
+        double minValue = qQNaN(), maxValue = qQNaN();
+        bucket.minOffset = bucket.maxOffset = quint32(first-b*size);
+        for (quint64 i=first; i<last; ++i)
+        {
+          const double value = valueAt(i);
+          if (value < minValue || qIsNaN(minValue))
+          {
+            minValue = value;
+            bucket.minOffset = quint32(i-b*size);
+          }
+          if (value > maxValue || qIsNaN(maxValue))
+          {
+            maxValue = value;
+            bucket.maxOffset = quint32(i-b*size);
+          }
+        }
+        bucket.min = minValue;
+        bucket.max = maxValue;
+      } else
+      {
+        const Bucket &left = lower[(2*b) & lowerMask];
+        const Bucket &right = lower[(2*b+1) & lowerMask];
+        if ((2*b+1)*half >= end) // the right half has no values yet
+          bucket = left;
+        else if ((2*b+1)*half <= begin) // the left half lies entirely before begin
+        {
+          bucket = right;
+          bucket.minOffset += half;
+          bucket.maxOffset += half;
+        } else
+        {
+          const bool minFromLeft = !(right.min < left.min) && !qIsNaN(left.min);
+          const bool maxFromLeft = !(right.max > left.max) && !qIsNaN(left.max);
+          bucket.min = minFromLeft ? left.min : right.min;
+          bucket.max = maxFromLeft ? left.max : right.max;
+          bucket.minOffset = minFromLeft ? left.minOffset : right.minOffset+half;
+          bucket.maxOffset = maxFromLeft ? left.maxOffset : right.maxOffset+half;
+        }
+      }
+    }
+  }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPGraph
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*! \class QCPGraph
+  \brief A plottable representing a graph in a plot.
+
+  \image html QCPGraph.png
+  
+  Usually you create new graphs by calling QCustomPlot::addGraph. The resulting instance can be
+  accessed via QCustomPlot::graph.
+
+  To plot data, assign it with the \ref setData or \ref addData functions. Alternatively, you can
+  also access and modify the graph's data via the \ref data method, which returns a pointer to the
+  internal \ref QCPDataMap.
+  
+  Graphs are used to display single-valued data. Single-valued means that there should only be one
+  data point per unique key coordinate. In other words, the graph can't have \a loops. If you do
+  want to plot non-single-valued curves, rather use the QCPCurve plottable.
+  
+  Gaps in the graph line can be created by adding data points with NaN as value
+  (<tt>qQNaN()</tt> or <tt>std::numeric_limits<double>::quiet_NaN()</tt>) in between the two data points that shall be
+  separated.
+  
+  \section appearance Changing the appearance
+  
+  The appearance of the graph is mainly determined by the line style, scatter style, brush and pen
+  of the graph (\ref setLineStyle, \ref setScatterStyle, \ref setBrush, \ref setPen).
+  
+  \subsection filling Filling under or between graphs
+  
+  QCPGraph knows two types of fills: Normal graph fills towards the zero-value-line parallel to
+  the key axis of the graph, and fills between two graphs, called channel fills. To enable a fill,
+  just set a brush with \ref setBrush which is neither Qt::NoBrush nor fully transparent.
+  
+  By default, a normal fill towards the zero-value-line will be drawn. To set up a channel fill
+  between this graph and another one, call \ref setChannelFillGraph with the other graph as
+  parameter.
+
+  \see QCustomPlot::addGraph, QCustomPlot::graph
+*/
+
+/* start of documentation of inline functions */
+
+/*! \fn QCPDataMap *QCPGraph::data() const
+  
+  Returns a pointer to the internal data storage of type \ref QCPDataMap. You may use it to
+  directly manipulate the data, which may be more convenient and faster than using the regular \ref
+  setData or \ref addData methods, in certain situations.
+*/
+
+/* end of documentation of inline functions */
+
+/*!
+  Constructs a graph which uses \a keyAxis as its key axis ("x") and \a valueAxis as its value
+  axis ("y"). \a keyAxis and \a valueAxis must reside in the same QCustomPlot instance and not have
+  the same orientation. If either of these restrictions is violated, a corresponding message is
+  printed to the debug output (qDebug), the construction is not aborted, though.
+  
+  The constructed QCPGraph can be added to the plot with QCustomPlot::addPlottable, QCustomPlot
+  then takes ownership of the graph.
+  
+  To directly create a graph inside a plot, you can also use the simpler QCustomPlot::addGraph function.
+*/
+QCPGraph::QCPGraph(QCPAxis *keyAxis, QCPAxis *valueAxis) :
+  QCPAbstractPlottable(keyAxis, valueAxis)
+{
+  mData = new QCPDataMap;
   
   setPen(QPen(Qt::blue, 0));
   setErrorPen(QPen(Qt::black));
@@ -14497,6 +15437,7 @@ QCPGraph::QCPGraph(QCPAxis *keyAxis, QCPAxis *valueAxis) :
   setErrorBarSkipSymbol(true);
   setChannelFillGraph(0);
   setAdaptiveSampling(true);
+  setMinMaxPyramid(false);
 }
 
 QCPGraph::~QCPGraph()
@@ -14529,6 +15470,7 @@ void QCPGraph::setData(QCPDataMap *data, bool copy)
     delete mData;
     mData = data;
   }
+  mPyramid.clear();
 }
 
 /*! \overload
@@ -14539,16 +15481,22 @@ void QCPGraph::setData(QCPDataMap *data, bool copy)
 */
 void QCPGraph::setData(const QVector<double> &key, const QVector<double> &value)
 {
-  mData->clear();
-  int n = key.size();
-  n = qMin(n, value.size());
-  QCPData newData;
-  for (int i=0; i<n; ++i)
-  {
-    newData.key = key[i];
-    newData.value = value[i];
-    mData->insertMulti(newData.key, newData);
-  }
+  mData->set(key, value);
+}
+
+/*! \overload
+  
+  Replaces the current data with the points in \a data without copying them. The graph swaps
+  \a data with its internal storage, so afterwards \a data holds the points the graph had before.
+  Refilling and adopting the same vector every frame therefore neither allocates nor copies.
+  
+  If \a alreadySorted is true, the keys in \a data must be ascending; otherwise they are sorted.
+  
+  \see QCPDataContainer::adopt
+*/
+void QCPGraph::adoptData(QVector<QCPData> &data, bool alreadySorted)
+{
+  mData->adopt(data, alreadySorted);
 }
 
 /*!
@@ -14851,6 +15799,24 @@ void QCPGraph::setAdaptiveSampling(bool enabled)
   mAdaptiveSampling = enabled;
 }
 
+/*!
+  Sets whether line plots of many points use a \ref QCPMinMaxPyramid instead of walking every
+  visible point. Requires adaptive sampling (\ref setAdaptiveSampling) to be enabled.
+  
+  With the pyramid, the graph keeps a min/max summary of its data at every power of two and
+  updates it incrementally when points are appended. A replot then picks the level with about one
+  bucket per pixel and draws the minimum and maximum of each bucket, so its cost is bounded by the
+  width of the plot rather than by the number of points in view. This is meant for long streams
+  of samples, e.g. a scrolling recording that is zoomed out to millions of points. It costs about
+  16 bytes per data point. Scatter plots are not affected.
+*/
+void QCPGraph::setMinMaxPyramid(bool enabled)
+{
+  mMinMaxPyramid = enabled;
+  if (!enabled)
+    mPyramid = QCPMinMaxPyramid(); // release the buckets
+}
+
 /*!
   Adds the provided data points in \a dataMap to the current data.
   
@@ -14903,14 +15869,7 @@ void QCPGraph::addData(double key, double value)
 */
 void QCPGraph::addData(const QVector<double> &keys, const QVector<double> &values)
 {
-  int n = qMin(keys.size(), values.size());
-  QCPData newData;
-  for (int i=0; i<n; ++i)
-  {
-    newData.key = keys[i];
-    newData.value = values[i];
-    mData->insertMulti(newData.key, newData);
-  }
+  mData->add(keys, values);
 }
 
 /*!
@@ -14919,9 +15878,7 @@ void QCPGraph::addData(const QVector<double> &keys, const QVector<double> &value
 */
 void QCPGraph::removeDataBefore(double key)
 {
-  QCPDataMap::iterator it = mData->begin();
-  while (it != mData->end() && it.key() < key)
-    it = mData->erase(it);
+  mData->erase(mData->begin(), mData->lowerBound(key));
 }
 
 /*!
@@ -14931,9 +15888,7 @@ void QCPGraph::removeDataBefore(double key)
 void QCPGraph::removeDataAfter(double key)
 {
   if (mData->isEmpty()) return;
-  QCPDataMap::iterator it = mData->upperBound(key);
-  while (it != mData->end())
-    it = mData->erase(it);
+  mData->erase(mData->upperBound(key), mData->end());
 }
 
 /*!
@@ -14948,8 +15903,7 @@ void QCPGraph::removeData(double fromKey, double toKey)
   if (fromKey >= toKey || mData->isEmpty()) return;
   QCPDataMap::iterator it = mData->upperBound(fromKey);
   QCPDataMap::iterator itEnd = mData->upperBound(toKey);
-  while (it != itEnd)
-    it = mData->erase(it);
+  mData->erase(it, itEnd);
 }
 
 /*! \overload
@@ -15646,6 +16600,43 @@ void QCPGraph::drawImpulsePlot(QCPPainter *painter, QVector<QPointF> *lineData)
   }
 }
 
+/*! \internal
+  
+  The line part of \ref getPreparedData when \ref setMinMaxPyramid is enabled: brings the pyramid
+  up to date, picks the level with at most \a keyPixelSpan buckets between \a lower and \a upper
+  and appends the minimum and maximum point of each of those buckets, in key order, to \a lineData.
+  The first and last point are always included, so the line ends where it would without sampling.
+*/
+void QCPGraph::getPyramidLineData(QVector<QCPData> *lineData, const QCPDataMap::const_iterator &lower, const QCPDataMap::const_iterator &upper, int keyPixelSpan) const
+{
+  mPyramid.update(*mData);
+  const QCPData *data = mData->vector().constData();
+  const int first = lower-mData->constBegin();
+  const int last = upper-mData->constBegin();
+  const int level = mPyramid.levelFor((last-first+1)/double(qMax(keyPixelSpan, 1)));
+  if (level < 0)
+  {
+    for (int i=first; i<=last; ++i)
+      lineData->append(data[i]);
+    return;
+  }
+  
+  const int shift = level+1; // log2 of the bucket size
+  lineData->reserve(2*((last>>shift)-(first>>shift)+1)+2);
+  lineData->append(data[first]);
+  for (int b=first>>shift; b<=last>>shift; ++b)
+  {
+    const QCPMinMaxPyramid::Bucket &bucket = mPyramid.bucket(level, b);
+    int i = (b<<shift)+int(qMin(bucket.minOffset, bucket.maxOffset));
+    int j = (b<<shift)+int(qMax(bucket.minOffset, bucket.maxOffset));
+    if (i > first && i < last)
+      lineData->append(data[i]);
+    if (j != i && j > first && j < last)
+      lineData->append(data[j]);
+  }
+  lineData->append(data[last]);
+}
+
 /*! \internal
   
   Returns the \a lineData and \a scatterData that need to be plotted for this graph taking into
@@ -15680,7 +16671,10 @@ void QCPGraph::getPreparedData(QVector<QCPData> *lineData, QVector<QCPData> *sca
   
   if (mAdaptiveSampling && dataCount >= maxCount) // use adaptive sampling only if there are at least two points per pixel on average
   {
-    if (lineData)
+    if (lineData && mMinMaxPyramid)
+    {
+      getPyramidLineData(lineData, lower, upper, maxCount/2-1);
+    } else if (lineData)
     {
       QCPDataMap::const_iterator it = lower;
       QCPDataMap::const_iterator upperEnd = upper+1;
@@ -15968,8 +16962,9 @@ void QCPGraph::getVisibleDataBounds(QCPDataMap::const_iterator &lower, QCPDataMa
   }
   
   // get visible data range as QMap iterators
-  QCPDataMap::const_iterator lbound = mData->lowerBound(mKeyAxis.data()->range().lower);
-  QCPDataMap::const_iterator ubound = mData->upperBound(mKeyAxis.data()->range().upper);
+  const QCPDataMap *data = mData; // the const overloads leave the change tracking alone
+  QCPDataMap::const_iterator lbound = data->lowerBound(mKeyAxis.data()->range().lower);
+  QCPDataMap::const_iterator ubound = data->upperBound(mKeyAxis.data()->range().upper);
   bool lowoutlier = lbound != mData->constBegin(); // indicates whether there exist points below axis range
   bool highoutlier = ubound != mData->constEnd(); // indicates whether there exist points above axis range
   
@@ -15991,14 +16986,7 @@ int QCPGraph::countDataInBounds(const QCPDataMap::const_iterator &lower, const Q
 {
   if (upper == mData->constEnd() && lower == mData->constEnd())
     return 0;
-  QCPDataMap::const_iterator it = lower;
-  int count = 1;
-  while (it != upper && count < maxCount)
-  {
-    ++it;
-    ++count;
-  }
-  return count;
+  return qMin(upper-lower+1, maxCount); // the data is contiguous, so no need to walk it
 }
 
 /*! \internal
@@ -16651,82 +17639,544 @@ QCPRange QCPGraph::getValueRange(bool &foundRange, SignDomain inSignDomain, bool
     }
   } else if (inSignDomain == sdNegative) // range may only be in the negative sign domain
   {
-    QCPDataMap::const_iterator it = mData->constBegin();
-    while (it != mData->constEnd())
+    QCPDataMap::const_iterator it = mData->constBegin();
+    while (it != mData->constEnd())
+    {
+      current = it.value().value;
+      if (!qIsNaN(current))
+      {
+        currentErrorMinus = (includeErrors ? it.value().valueErrorMinus : 0);
+        currentErrorPlus = (includeErrors ? it.value().valueErrorPlus : 0);
+        if ((current-currentErrorMinus < range.lower || !haveLower) && current-currentErrorMinus < 0)
+        {
+          range.lower = current-currentErrorMinus;
+          haveLower = true;
+        }
+        if ((current+currentErrorPlus > range.upper || !haveUpper) && current+currentErrorPlus < 0)
+        {
+          range.upper = current+currentErrorPlus;
+          haveUpper = true;
+        }
+        if (includeErrors) // in case point is in valid sign domain but errobars stretch beyond it, we still want to get that point.
+        {
+          if ((current < range.lower || !haveLower) && current < 0)
+          {
+            range.lower = current;
+            haveLower = true;
+          }
+          if ((current > range.upper || !haveUpper) && current < 0)
+          {
+            range.upper = current;
+            haveUpper = true;
+          }
+        }
+      }
+      ++it;
+    }
+  } else if (inSignDomain == sdPositive) // range may only be in the positive sign domain
+  {
+    QCPDataMap::const_iterator it = mData->constBegin();
+    while (it != mData->constEnd())
+    {
+      current = it.value().value;
+      if (!qIsNaN(current))
+      {
+        currentErrorMinus = (includeErrors ? it.value().valueErrorMinus : 0);
+        currentErrorPlus = (includeErrors ? it.value().valueErrorPlus : 0);
+        if ((current-currentErrorMinus < range.lower || !haveLower) && current-currentErrorMinus > 0)
+        {
+          range.lower = current-currentErrorMinus;
+          haveLower = true;
+        }
+        if ((current+currentErrorPlus > range.upper || !haveUpper) && current+currentErrorPlus > 0)
+        {
+          range.upper = current+currentErrorPlus;
+          haveUpper = true;
+        }
+        if (includeErrors) // in case point is in valid sign domain but errobars stretch beyond it, we still want to geht that point.
+        {
+          if ((current < range.lower || !haveLower) && current > 0)
+          {
+            range.lower = current;
+            haveLower = true;
+          }
+          if ((current > range.upper || !haveUpper) && current > 0)
+          {
+            range.upper = current;
+            haveUpper = true;
+          }
+        }
+      }
+      ++it;
+    }
+  }
+  
+  foundRange = haveLower && haveUpper;
+  return range;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPStreamSource
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*! \class QCPStreamSource
+  \brief Interface of a ring buffer of uniformly sampled values, as displayed by QCPStreamGraph.
+  
+  The samples are addressed by an absolute, ever increasing index. \ref sampleCount returns the
+  number of samples written so far, and sample \a i is stored at <tt>buffer()[i &
+  (capacity()-1)]</tt>, so \ref capacity must be a power of two. Once the buffer is full, the
+  oldest samples are overwritten. A source stores either doubles or floats: exactly one of \ref
+  buffer and \ref floatBuffer is reimplemented to return the storage.
+  
+  The source may be written by another thread while it is plotted, as long as \ref sampleCount
+  only grows after the samples up to it were stored. A source may also show fewer samples than
+  were written, e.g. to keep several graphs in step; \ref writePosition then tells how far the
+  writer has got. QCPStreamGraph leaves out the quarter of the buffer ahead of the writer, and
+  after reading checks with \ref isIntact that the writer did not catch up with it in the
+  meantime; if it did, the frame is dropped.
+*/
+
+/* start documentation of pure virtual functions */
+
+/*! \fn quint64 QCPStreamSource::sampleCount() const
+  
+  Returns the total number of samples written to the source so far.
+*/
+
+/*! \fn int QCPStreamSource::capacity() const
+  
+  Returns the number of samples the buffer holds. Must be a power of two and must not change while
+  the source is plotted.
+*/
+
+/*! \fn quint64 QCPStreamSource::writePosition() const
+  
+  Returns the number of samples the writer has stored so far, which may be ahead of \ref
+  sampleCount. The default implementation returns \ref sampleCount.
+*/
+
+/*! \fn bool QCPStreamSource::isIntact(quint64 begin) const
+  
+  Returns true if the samples from absolute index \a begin on have not been overwritten. Call it
+  after reading the samples; a source written by another thread must make sure the reads are
+  ordered before the check. The default implementation compares \a begin with \ref
+  writePosition.
+*/
+
+/*! \fn const double *QCPStreamSource::buffer() const
+  
+  Returns the ring buffer storage of \ref capacity samples, or 0 if the source stores floats.
+*/
+
+/*! \fn const float *QCPStreamSource::floatBuffer() const
+  
+  Returns the ring buffer storage of \ref capacity samples, or 0 if the source stores doubles.
+*/
+
+/* end documentation of pure virtual functions */
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPStreamGraph
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*! \class QCPStreamGraph
+  \brief A plottable that draws a scrolling window straight out of a ring buffer of samples
+  
+  Where QCPGraph keeps its own copy of arbitrary (key, value) pairs, QCPStreamGraph displays the
+  samples of a \ref QCPStreamSource in place. The key of a sample follows from its index: sample
+  \a i is drawn at key <tt>keyOffset + (i - origin) * samplePeriod</tt>. With a \ref
+  setScrollWindow "scroll window" of \a n samples, the origin moves with the stream such that the
+  newest sample is always at index n-1 relative to the key offset, i.e. the plot scrolls while the
+  axis range stays fixed. Without a scroll window, the origin is the first sample of the stream.
+  
+  Appending samples to the source costs nothing on the plot side, and old samples fall off as the
+  source overwrites them. When drawing, the graph only looks at the samples appended since the
+  last replot: it keeps a \ref QCPMinMaxPyramid over the ring and draws one min/max pair per pixel
+  when zoomed out, so a replot costs time proportional to the plot width plus the number of new
+  samples.
+  
+  The graph does not own the source. To create a stream graph, pass the axes to the constructor and
+  add it to the plot with \ref QCustomPlot::addPlottable.
+*/
+
+/* start of documentation of inline functions */
+
+/*! \fn QCPStreamSource *QCPStreamGraph::source() const
+  
+  Returns the source the graph displays, or 0 if none is set.
+  
+  \see setSource
+*/
+
+/* end of documentation of inline functions */
+
+/*!
+  Constructs a stream graph which uses \a keyAxis as its key axis ("x") and \a valueAxis as its
+  value axis ("y"). \a keyAxis and \a valueAxis must reside in the same QCustomPlot instance and
+  not have the same orientation.
+  
+  The constructed QCPStreamGraph can be added to the plot with QCustomPlot::addPlottable,
+  QCustomPlot then takes ownership of the graph. It draws nothing until a source is set with \ref
+  setSource.
+*/
+QCPStreamGraph::QCPStreamGraph(QCPAxis *keyAxis, QCPAxis *valueAxis) :
+  QCPAbstractPlottable(keyAxis, valueAxis),
+  mSource(0),
+  mSamplePeriod(1),
+  mKeyOffset(0),
+  mScrollWindow(0)
+{
+  setPen(QPen(Qt::blue, 0));
+  setBrush(Qt::NoBrush);
+  setSelectedPen(QPen(QColor(80, 80, 255), 2.5));
+  setSelectedBrush(Qt::NoBrush);
+}
+
+QCPStreamGraph::~QCPStreamGraph()
+{
+}
+
+/*!
+  Sets the ring buffer the graph displays. The graph does not take ownership of \a source, which
+  must stay valid as long as it is set. Pass 0 to detach the graph from its source.
+*/
+void QCPStreamGraph::setSource(QCPStreamSource *source)
+{
+  if (source && (source->capacity() < 2 || (source->capacity() & (source->capacity()-1)) != 0))
+  {
+    qDebug() << Q_FUNC_INFO << "source capacity is not a power of two:" << source->capacity();
+    return;
+  }
+  mSource = source;
+  mPyramid.clear();
+  mLineData.clear();
+}
+
+/*!
+  Sets the key distance between two consecutive samples, e.g. the inverse sample rate.
+*/
+void QCPStreamGraph::setSamplePeriod(double period)
+{
+  mSamplePeriod = period;
+}
+
+/*!
+  Sets the key at which the sample at the origin is drawn.
+  
+  \see setScrollWindow
+*/
+void QCPStreamGraph::setKeyOffset(double offset)
+{
+  mKeyOffset = offset;
+}
+
+/*!
+  If \a samples is larger than zero, the graph scrolls: the origin follows the stream such that the
+  newest sample is drawn at key <tt>keyOffset + (samples-1) * samplePeriod</tt>. An axis range
+  spanning \a samples sample periods from the key offset then always shows the latest \a samples
+  samples.
+  
+  If \a samples is zero, sample indices are counted from the start of the stream.
+*/
+void QCPStreamGraph::setScrollWindow(int samples)
+{
+  mScrollWindow = qMax(0, samples);
+}
+
+/*!
+  Returns the key at which the sample with the absolute index \a index is currently drawn.
+*/
+double QCPStreamGraph::sampleKey(quint64 index) const
+{
+  return indexToKey(index, mScrollWindow > 0 && mSource ? double(mSource->sampleCount()) - mScrollWindow : 0);
+}
+
+/*!
+  Detaches the graph from its source. The samples themselves belong to the source and are not
+  touched.
+*/
+void QCPStreamGraph::clearData()
+{
+  setSource(0);
+}
+
+/* inherits documentation from base class */
+double QCPStreamGraph::selectTest(const QPointF &pos, bool onlySelectable, QVariant *details) const
+{
+  Q_UNUSED(details)
+  if ((onlySelectable && !mSelectable) || mLineData.isEmpty())
+    return -1;
+  if (!mKeyAxis || !mValueAxis) { qDebug() << Q_FUNC_INFO << "invalid key or value axis"; return -1; }
+  
+  if (!mKeyAxis.data()->axisRect()->rect().contains(pos.toPoint()))
+    return -1;
+  
+  // test against the line as it was drawn at the last replot:
+  if (mLineData.size() == 1)
+    return QVector2D(mLineData.first()-pos).length();
+  double minDistSqr = std::numeric_limits<double>::max();
+  for (int i=1; i<mLineData.size(); ++i)
+  {
+    double currentDistSqr = distSqrToLine(mLineData.at(i-1), mLineData.at(i), pos);
+    if (currentDistSqr < minDistSqr)
+      minDistSqr = currentDistSqr;
+  }
+  return qSqrt(minDistSqr);
+}
+
+/* inherits documentation from base class */
+void QCPStreamGraph::draw(QCPPainter *painter)
+{
+  if (!mKeyAxis || !mValueAxis) { qDebug() << Q_FUNC_INFO << "invalid key or value axis"; return; }
+  mLineData.resize(0);
+  if (mKeyAxis.data()->range().size() <= 0) return;
+  
+  quint64 begin, end;
+  if (!retainedRange(begin, end))
+    return;
+  updatePyramid(begin, end);
+  getLineData(&mLineData, begin, end);
+  if (!mSource->isIntact(begin))
+  {
+    // the writer caught up with what we read; drop the frame and everything summarized from it
+    mPyramid.clear();
+    mLineData.resize(0);
+    return;
+  }
+  
+  if (mainPen().style() == Qt::NoPen || mainPen().color().alpha() == 0)
+    return;
+  applyDefaultAntialiasingHint(painter);
+  painter->setPen(mainPen());
+  painter->setBrush(Qt::NoBrush);
+  
+  // if drawing solid line and not in PDF, use much faster line drawing instead of polyline:
+  const int lineDataSize = mLineData.size();
+  if (mParentPlot->plottingHints().testFlag(QCP::phFastPolylines) &&
+      painter->pen().style() == Qt::SolidLine &&
+      !painter->modes().testFlag(QCPPainter::pmVectorized) &&
+      !painter->modes().testFlag(QCPPainter::pmNoCaching))
+  {
+    for (int i=1; i<lineDataSize; ++i)
+    {
+      if (!qIsNaN(mLineData.at(i).y()) && !qIsNaN(mLineData.at(i-1).y())) // NaNs create a gap in the line
+        painter->drawLine(mLineData.at(i-1), mLineData.at(i));
+    }
+  } else
+  {
+    int segmentStart = 0;
+    for (int i=0; i<lineDataSize; ++i)
+    {
+      if (qIsNaN(mLineData.at(i).y()) || qIsInf(mLineData.at(i).y())) // NaNs create a gap in the line. Also filter Infs which make drawPolyline block
+      {
+        painter->drawPolyline(mLineData.constData()+segmentStart, i-segmentStart);
+        segmentStart = i+1;
+      }
+    }
+    painter->drawPolyline(mLineData.constData()+segmentStart, lineDataSize-segmentStart);
+  }
+}
+
+/* inherits documentation from base class */
+void QCPStreamGraph::drawLegendIcon(QCPPainter *painter, const QRectF &rect) const
+{
+  // draw line vertically centered:
+  applyDefaultAntialiasingHint(painter);
+  painter->setPen(mPen);
+  painter->drawLine(QLineF(rect.left(), rect.top()+rect.height()/2.0, rect.right()+5, rect.top()+rect.height()/2.0)); // +5 on x2 else last segment is missing from dashed/dotted pens
+}
+
+/* inherits documentation from base class */
+QCPRange QCPStreamGraph::getKeyRange(bool &foundRange, SignDomain inSignDomain) const
+{
+  quint64 begin, end;
+  foundRange = false;
+  if (!retainedRange(begin, end))
+    return QCPRange();
+  
+  QCPRange range(sampleKey(begin), sampleKey(end-1));
+  range.normalize();
+  // the keys are spaced by the sample period, so the sample closest to zero is easy to find:
+  const double step = qAbs(mSamplePeriod);
+  if (inSignDomain == sdPositive)
+  {
+    if (range.upper <= 0) return QCPRange();
+    if (range.lower <= 0)
+      range.lower += (qFloor(-range.lower/step)+1)*step;
+  } else if (inSignDomain == sdNegative)
+  {
+    if (range.lower >= 0) return QCPRange();
+    if (range.upper >= 0)
+      range.upper -= (qFloor(range.upper/step)+1)*step;
+  }
+  foundRange = true;
+  return range;
+}
+
+/* inherits documentation from base class */
+QCPRange QCPStreamGraph::getValueRange(bool &foundRange, SignDomain inSignDomain) const
+{
+  QCPRange range;
+  foundRange = false;
+  
+  quint64 begin, end;
+  if (retainedRange(begin, end))
+  {
+    if (const double *buffer = mSource->buffer())
+      range = getRingValueRange(buffer, begin, end, inSignDomain, foundRange);
+    else
+      range = getRingValueRange(mSource->floatBuffer(), begin, end, inSignDomain, foundRange);
+    if (!mSource->isIntact(begin)) // the writer overtook the scan, the range is unreliable
+      foundRange = false;
+  }
+  return range;
+}
+
+/*! \internal
+  
+  Returns the key of the sample with the absolute index \a index, if the origin of the keys is at
+  sample \a origin.
+*/
+double QCPStreamGraph::indexToKey(quint64 index, double origin) const
+{
+  return mKeyOffset + (double(index)-origin)*mSamplePeriod;
+}
+
+/*! \internal
+  
+  Sets \a begin and \a end to the absolute indices of the samples that may be displayed, and
+  returns false if there are none. The quarter of the ring ahead of the writer's current position
+  is left out, so the writer has to advance by that much before it touches a sample a replot
+  reads; whether it did is checked with \ref QCPStreamSource::isIntact after reading.
+*/
+bool QCPStreamGraph::retainedRange(quint64 &begin, quint64 &end) const
+{
+  if (!mSource)
+    return false;
+  end = mSource->sampleCount();
+  const quint64 written = qMax(mSource->writePosition(), end);
+  const quint64 retained = mSource->capacity() - mSource->capacity()/4;
+  begin = written > retained ? written-retained : 0;
+  return end > begin;
+}
+
+/*! \internal
+  
+  Brings the min/max pyramid up to date with the samples in [\a begin, \a end). Only the buckets
+  covering samples appended since the previous call are recomputed.
+*/
+void QCPStreamGraph::updatePyramid(quint64 begin, quint64 end)
+{
+  if (const double *buffer = mSource->buffer())
+    mPyramid.update(buffer, mSource->capacity(), begin, end);
+  else
+    mPyramid.update(mSource->floatBuffer(), mSource->capacity(), begin, end);
+}
+
+/*! \internal
+  
+  Fills \a lineData with the pixel coordinates of the line through the visible samples in
+  [\a begin, \a end). If there are only a few samples per pixel, every sample becomes a point of
+  the line. Otherwise the pyramid level with about one bucket per pixel is used, and every bucket
+  contributes its minimum and maximum in the order they occur in the stream.
+*/
+void QCPStreamGraph::getLineData(QVector<QPointF> *lineData, quint64 begin, quint64 end) const
+{
+  QCPAxis *keyAxis = mKeyAxis.data();
+  if (mSamplePeriod == 0)
+    return;
+  
+  // find the visible samples, plus one beyond each side so the line leaves the axis rect:
+  const double origin = mScrollWindow > 0 ? double(end) - mScrollWindow : 0;
+  double first = (keyAxis->range().lower-mKeyOffset)/mSamplePeriod + origin;
+  double last = (keyAxis->range().upper-mKeyOffset)/mSamplePeriod + origin;
+  if (first > last)
+    qSwap(first, last);
+  first = qMax(double(begin), qFloor(first)-1.0);
+  last = qMin(double(end-1), qCeil(last)+1.0);
+  if (first > last)
+    return;
+  const quint64 lowerIndex = quint64(first);
+  const quint64 upperIndex = quint64(last)+1;
+  
+  const double keyPixelSpan = qAbs(keyAxis->coordToPixel(indexToKey(lowerIndex, origin))-keyAxis->coordToPixel(indexToKey(upperIndex-1, origin)));
+  const double pointsPerPixel = (upperIndex-lowerIndex)/qMax(1.0, keyPixelSpan);
+  
+  const int level = mPyramid.levelFor(pointsPerPixel);
+  if (pointsPerPixel < 4 || level < 0)
+  {
+    if (const double *buffer = mSource->buffer())
+      getRingLineData(lineData, buffer, lowerIndex, upperIndex, origin);
+    else
+      getRingLineData(lineData, mSource->floatBuffer(), lowerIndex, upperIndex, origin);
+    return;
+  }
+  
+  const quint64 size = mPyramid.bucketSize(level);
+  const quint64 lowerBucket = lowerIndex/size;
+  const quint64 upperBucket = (upperIndex-1)/size;
+  lineData->reserve(2*(upperBucket-lowerBucket+1));
+  for (quint64 b=lowerBucket; b<=upperBucket; ++b)
+  {
+    // the minimum and maximum in the order they occur in the stream, at their own keys:
+    const QCPMinMaxPyramid::Bucket &bucket = mPyramid.bucket(level, b);
+    const bool minFirst = bucket.minOffset <= bucket.maxOffset;
+    lineData->append(coordsToPixels(indexToKey(b*size+(minFirst ? bucket.minOffset : bucket.maxOffset), origin), minFirst ? bucket.min : bucket.max));
+    lineData->append(coordsToPixels(indexToKey(b*size+(minFirst ? bucket.maxOffset : bucket.minOffset), origin), minFirst ? bucket.max : bucket.min));
+  }
+}
+
+/*! \internal
+  
+  Returns the range of the samples in [\a begin, \a end) of the source's \a ring, its \ref
+  QCPStreamSource::buffer or \ref QCPStreamSource::floatBuffer, that lie in \a inSignDomain. NaN
+  samples are skipped. \a foundRange is set to whether there was any such sample.
+*/
+template <typename Sample>
+QCPRange QCPStreamGraph::getRingValueRange(const Sample *ring, quint64 begin, quint64 end, SignDomain inSignDomain, bool &foundRange) const
+{
+  QCPRange range;
+  bool haveLower = false;
+  bool haveUpper = false;
+  const quint64 mask = mSource->capacity()-1;
+  for (quint64 i=begin; i<end; ++i)
+  {
+    const double current = ring[i & mask];
+    if (qIsNaN(current))
+      continue;
+    if ((inSignDomain == sdPositive && current <= 0) || (inSignDomain == sdNegative && current >= 0))
+      continue;
+    if (current < range.lower || !haveLower)
     {
-      current = it.value().value;
-      if (!qIsNaN(current))
-      {
-        currentErrorMinus = (includeErrors ? it.value().valueErrorMinus : 0);
-        currentErrorPlus = (includeErrors ? it.value().valueErrorPlus : 0);
-        if ((current-currentErrorMinus < range.lower || !haveLower) && current-currentErrorMinus < 0)
-        {
-          range.lower = current-currentErrorMinus;
-          haveLower = true;
-        }
-        if ((current+currentErrorPlus > range.upper || !haveUpper) && current+currentErrorPlus < 0)
-        {
-          range.upper = current+currentErrorPlus;
-          haveUpper = true;
-        }
-        if (includeErrors) // in case point is in valid sign domain but errobars stretch beyond it, we still want to get that point.
-        {
-          if ((current < range.lower || !haveLower) && current < 0)
-          {
-            range.lower = current;
-            haveLower = true;
-          }
-          if ((current > range.upper || !haveUpper) && current < 0)
-          {
-            range.upper = current;
-            haveUpper = true;
-          }
-        }
-      }
-      ++it;
+      range.lower = current;
+      haveLower = true;
     }
-  } else if (inSignDomain == sdPositive) // range may only be in the positive sign domain
-  {
-    QCPDataMap::const_iterator it = mData->constBegin();
-    while (it != mData->constEnd())
+    if (current > range.upper || !haveUpper)
     {
-      current = it.value().value;
-      if (!qIsNaN(current))
-      {
-        currentErrorMinus = (includeErrors ? it.value().valueErrorMinus : 0);
-        currentErrorPlus = (includeErrors ? it.value().valueErrorPlus : 0);
-        if ((current-currentErrorMinus < range.lower || !haveLower) && current-currentErrorMinus > 0)
-        {
-          range.lower = current-currentErrorMinus;
-          haveLower = true;
-        }
-        if ((current+currentErrorPlus > range.upper || !haveUpper) && current+currentErrorPlus > 0)
-        {
-          range.upper = current+currentErrorPlus;
-          haveUpper = true;
-        }
-        if (includeErrors) // in case point is in valid sign domain but errobars stretch beyond it, we still want to geht that point.
-        {
-          if ((current < range.lower || !haveLower) && current > 0)
-          {
-            range.lower = current;
-            haveLower = true;
-          }
-          if ((current > range.upper || !haveUpper) && current > 0)
-          {
-            range.upper = current;
-            haveUpper = true;
-          }
-        }
-      }
-      ++it;
+      range.upper = current;
+      haveUpper = true;
     }
   }
-  
   foundRange = haveLower && haveUpper;
   return range;
 }
 
+/*! \internal
+  
+  Appends to \a lineData one point per sample in [\a begin, \a end) of the source's \a ring, with
+  the keys counted from sample \a origin.
+*/
+template <typename Sample>
+void QCPStreamGraph::getRingLineData(QVector<QPointF> *lineData, const Sample *ring, quint64 begin, quint64 end, double origin) const
+{
+  const quint64 mask = mSource->capacity()-1;
+  lineData->reserve(end-begin);
+  for (quint64 i=begin; i<end; ++i)
+    lineData->append(coordsToPixels(indexToKey(i, origin), ring[i & mask]));
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////// QCPCurveData
@@ -19637,7 +21087,10 @@ QCPColorMapData::QCPColorMapData(int keySize, int valueSize, const QCPRange &key
   mValueRange(valueRange),
   mIsEmpty(true),
   mData(0),
-  mDataModified(true)
+  mDataModified(true),
+  mModifiedFirst(0),
+  mModifiedLast(-1),
+  mScrolledRows(0)
 {
   setSize(keySize, valueSize);
   fill(0);
@@ -19657,7 +21110,10 @@ QCPColorMapData::QCPColorMapData(const QCPColorMapData &other) :
   mValueSize(0),
   mIsEmpty(true),
   mData(0),
-  mDataModified(true)
+  mDataModified(true),
+  mModifiedFirst(0),
+  mModifiedLast(-1),
+  mScrolledRows(0)
 {
   *this = other;
 }
@@ -19676,7 +21132,7 @@ QCPColorMapData &QCPColorMapData::operator=(const QCPColorMapData &other)
     if (!mIsEmpty)
       memcpy(mData, other.mData, sizeof(mData[0])*keySize*valueSize);
     mDataBounds = other.mDataBounds;
-    mDataModified = true;
+    markModified(0, mValueSize-1);
   }
   return *this;
 }
@@ -19737,7 +21193,7 @@ void QCPColorMapData::setSize(int keySize, int valueSize)
         qDebug() << Q_FUNC_INFO << "out of memory for data dimensions "<< mKeySize << "*" << mValueSize;
     } else
       mData = 0;
-    mDataModified = true;
+    markModified(0, mValueSize-1);
   }
 }
 
@@ -19840,7 +21296,7 @@ void QCPColorMapData::setData(double key, double value, double z)
       mDataBounds.lower = z;
     if (z > mDataBounds.upper)
       mDataBounds.upper = z;
-     mDataModified = true;
+    markModified(valueCell, valueCell);
   }
 }
 
@@ -19864,7 +21320,7 @@ void QCPColorMapData::setCell(int keyIndex, int valueIndex, double z)
       mDataBounds.lower = z;
     if (z > mDataBounds.upper)
       mDataBounds.upper = z;
-     mDataModified = true;
+    markModified(valueIndex, valueIndex);
   }
 }
 
@@ -19919,6 +21375,62 @@ void QCPColorMapData::fill(double z)
   for (int i=0; i<dataCount; ++i)
     mData[i] = z;
   mDataBounds = QCPRange(z, z);
+  markModified(0, mValueSize-1);
+}
+
+/*!
+  Moves the contents of all cells \a rows cells towards lower value indices. The \a rows lowest
+  value rows are discarded, the \a rows highest value rows are set to 0.
+  
+  This is the operation of a waterfall display that adds a new line at the top (highest value
+  index) with \ref setCell and lets the older lines scroll down. The color map doesn't recolorize
+  the scrolled cells, it moves its map image along and only colorizes the freed rows, so scrolling
+  costs about as much as updating one row per scrolled row.
+  
+  \a rows must be positive. If it is at least the value size, this is equivalent to \ref fill
+  "fill(0)".
+*/
+void QCPColorMapData::scrollValueRows(int rows)
+{
+  if (rows <= 0 || mIsEmpty || !mData)
+    return;
+  if (rows >= mValueSize)
+  {
+    fill(0);
+    return;
+  }
+  const int keptCells = (mValueSize-rows)*mKeySize;
+  memmove(mData, mData+rows*mKeySize, sizeof(mData[0])*keptCells);
+  const int dataCount = mValueSize*mKeySize;
+  for (int i=keptCells; i<dataCount; ++i)
+    mData[i] = 0;
+  if (0 < mDataBounds.lower)
+    mDataBounds.lower = 0;
+  if (0 > mDataBounds.upper)
+    mDataBounds.upper = 0;
+  
+  // rows that were waiting to be colorized moved along with their cells:
+  if (mDataModified)
+  {
+    mModifiedFirst = qMax(0, mModifiedFirst-rows);
+    mModifiedLast -= rows;
+    if (mModifiedLast < mModifiedFirst)
+      mDataModified = false;
+  }
+  mScrolledRows += rows;
+  markModified(mValueSize-rows, mValueSize-1);
+}
+
+/*! \internal
+  
+  Flags the cells with value indices from \a firstValueIndex to \a lastValueIndex (inclusive) as
+  modified. \ref QCPColorMap::updateMapImage only colorizes these rows again, unless the whole map
+  image has been invalidated.
+*/
+void QCPColorMapData::markModified(int firstValueIndex, int lastValueIndex)
+{
+  mModifiedFirst = mDataModified ? qMin(mModifiedFirst, firstValueIndex) : firstValueIndex;
+  mModifiedLast = mDataModified ? qMax(mModifiedLast, lastValueIndex) : lastValueIndex;
   mDataModified = true;
 }
 
@@ -20082,7 +21594,8 @@ QCPColorMap::QCPColorMap(QCPAxis *keyAxis, QCPAxis *valueAxis) :
   mMapData(new QCPColorMapData(10, 10, QCPRange(0, 5), QCPRange(0, 5))),
   mInterpolate(true),
   mTightBoundary(false),
-  mMapImageInvalidated(true)
+  mMapImageInvalidated(true),
+  mMapImageOrientation(Qt::Horizontal)
 {
 }
 
@@ -20334,6 +21847,11 @@ double QCPColorMap::selectTest(const QPointF &pos, bool onlySelectable, QVariant
   has been invalidated for a different reason (e.g. a change of the data range with \ref
   setDataRange).
   
+  If only some cells of the data were modified since the last update (see \ref
+  QCPColorMapData::setCell), only the image lines or columns of the affected value rows are
+  colorized again. This keeps continuously updated maps (e.g. a waterfall that overwrites one row
+  per update) from paying for the entire image on every replot.
+  
   If the map cell count is low, the image created will be oversampled in order to avoid a
   QPainter::drawImage bug which makes inner pixel boundaries jitter when stretch-drawing images
   without smooth transform enabled. Accordingly, oversampling isn't performed if \ref
@@ -20349,55 +21867,143 @@ void QCPColorMap::updateMapImage()
   const int valueSize = mMapData->valueSize();
   int keyOversamplingFactor = mInterpolate ? 1 : (int)(1.0+100.0/(double)keySize); // make mMapImage have at least size 100, factor becomes 1 if size > 200 or interpolation is on
   int valueOversamplingFactor = mInterpolate ? 1 : (int)(1.0+100.0/(double)valueSize); // make mMapImage have at least size 100, factor becomes 1 if size > 200 or interpolation is on
+  bool fullUpdate = mMapImageInvalidated || keyAxis->orientation() != mMapImageOrientation;
   
   // resize mMapImage to correct dimensions including possible oversampling factors, according to key/value axes orientation:
   if (keyAxis->orientation() == Qt::Horizontal && (mMapImage.width() != keySize*keyOversamplingFactor || mMapImage.height() != valueSize*valueOversamplingFactor))
+  {
     mMapImage = QImage(QSize(keySize*keyOversamplingFactor, valueSize*valueOversamplingFactor), QImage::Format_RGB32);
-  else if (keyAxis->orientation() == Qt::Vertical && (mMapImage.width() != valueSize*valueOversamplingFactor || mMapImage.height() != keySize*keyOversamplingFactor))
+    fullUpdate = true;
+  } else if (keyAxis->orientation() == Qt::Vertical && (mMapImage.width() != valueSize*valueOversamplingFactor || mMapImage.height() != keySize*keyOversamplingFactor))
+  {
     mMapImage = QImage(QSize(valueSize*valueOversamplingFactor, keySize*keyOversamplingFactor), QImage::Format_RGB32);
+    fullUpdate = true;
+  }
   
   QImage *localMapImage = &mMapImage; // this is the image on which the colorization operates. Either the final mMapImage, or if we need oversampling, mUndersampledMapImage
   if (keyOversamplingFactor > 1 || valueOversamplingFactor > 1)
   {
     // resize undersampled map image to actual key/value cell sizes:
     if (keyAxis->orientation() == Qt::Horizontal && (mUndersampledMapImage.width() != keySize || mUndersampledMapImage.height() != valueSize))
+    {
       mUndersampledMapImage = QImage(QSize(keySize, valueSize), QImage::Format_RGB32);
-    else if (keyAxis->orientation() == Qt::Vertical && (mUndersampledMapImage.width() != valueSize || mUndersampledMapImage.height() != keySize))
+      fullUpdate = true;
+    } else if (keyAxis->orientation() == Qt::Vertical && (mUndersampledMapImage.width() != valueSize || mUndersampledMapImage.height() != keySize))
+    {
       mUndersampledMapImage = QImage(QSize(valueSize, keySize), QImage::Format_RGB32);
+      fullUpdate = true;
+    }
     localMapImage = &mUndersampledMapImage; // make the colorization run on the undersampled image
   } else if (!mUndersampledMapImage.isNull())
     mUndersampledMapImage = QImage(); // don't need oversampling mechanism anymore (map size has changed) but mUndersampledMapImage still has nonzero size, free it
   
-  const double *rawData = mMapData->mData;
-  if (keyAxis->orientation() == Qt::Horizontal)
+  // range of value indices (data rows) that need to be colorized again:
+  int firstRow = 0;
+  int lastRow = valueSize-1;
+  if (!fullUpdate)
   {
-    const int lineCount = valueSize;
-    const int rowCount = keySize;
-    for (int line=0; line<lineCount; ++line)
+    firstRow = qMax(0, mMapData->mModifiedFirst);
+    lastRow = qMin(valueSize-1, mMapData->mModifiedLast);
+    // move the pixels of rows scrolled with QCPColorMapData::scrollValueRows instead of colorizing them again:
+    const int scrolledRows = mMapData->mScrolledRows;
+    if (scrolledRows > 0 && scrolledRows < valueSize && (firstRow > 0 || lastRow < valueSize-1))
     {
-      QRgb* pixels = reinterpret_cast<QRgb*>(localMapImage->scanLine(lineCount-1-line)); // invert scanline index because QImage counts scanlines from top, but our vertical index counts from bottom (mathematical coordinate system)
-      mGradient.colorize(rawData+line*rowCount, mDataRange, pixels, rowCount, 1, mDataScaleType==QCPAxis::stLogarithmic);
+      scrollMapImage(localMapImage, scrolledRows, keyAxis->orientation());
+      if (localMapImage != &mMapImage)
+        scrollMapImage(&mMapImage, scrolledRows*valueOversamplingFactor, keyAxis->orientation());
     }
-  } else // keyAxis->orientation() == Qt::Vertical
+  }
+  
+  const double *rawData = mMapData->mData;
+  const bool logarithmic = mDataScaleType==QCPAxis::stLogarithmic;
+  QRect updatedRect; // region of localMapImage that was colorized, in image pixels
+  if (firstRow <= lastRow)
   {
-    const int lineCount = keySize;
-    const int rowCount = valueSize;
-    for (int line=0; line<lineCount; ++line)
+    if (keyAxis->orientation() == Qt::Horizontal)
     {
-      QRgb* pixels = reinterpret_cast<QRgb*>(localMapImage->scanLine(lineCount-1-line)); // invert scanline index because QImage counts scanlines from top, but our vertical index counts from bottom (mathematical coordinate system)
-      mGradient.colorize(rawData+line, mDataRange, pixels, rowCount, lineCount, mDataScaleType==QCPAxis::stLogarithmic);
+      const int lineCount = valueSize;
+      const int rowCount = keySize;
+      for (int line=firstRow; line<=lastRow; ++line)
+      {
+        QRgb* pixels = reinterpret_cast<QRgb*>(localMapImage->scanLine(lineCount-1-line)); // invert scanline index because QImage counts scanlines from top, but our vertical index counts from bottom (mathematical coordinate system)
+        mGradient.colorize(rawData+line*rowCount, mDataRange, pixels, rowCount, 1, logarithmic);
+      }
+      updatedRect = QRect(0, lineCount-1-lastRow, rowCount, lastRow-firstRow+1);
+    } else // keyAxis->orientation() == Qt::Vertical
+    {
+      const int lineCount = keySize;
+      for (int line=0; line<lineCount; ++line)
+      {
+        QRgb* pixels = reinterpret_cast<QRgb*>(localMapImage->scanLine(lineCount-1-line)); // invert scanline index because QImage counts scanlines from top, but our vertical index counts from bottom (mathematical coordinate system)
+        mGradient.colorize(rawData+firstRow*lineCount+line, mDataRange, pixels+firstRow, lastRow-firstRow+1, lineCount, logarithmic);
+      }
+      updatedRect = QRect(firstRow, 0, lastRow-firstRow+1, lineCount);
     }
   }
   
-  if (keyOversamplingFactor > 1 || valueOversamplingFactor > 1)
+  if ((keyOversamplingFactor > 1 || valueOversamplingFactor > 1) && !updatedRect.isEmpty())
   {
-    if (keyAxis->orientation() == Qt::Horizontal)
-      mMapImage = mUndersampledMapImage.scaled(keySize*keyOversamplingFactor, valueSize*valueOversamplingFactor, Qt::IgnoreAspectRatio, Qt::FastTransformation);
-    else
-      mMapImage = mUndersampledMapImage.scaled(valueSize*valueOversamplingFactor, keySize*keyOversamplingFactor, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+    // replicate the updated pixels into mMapImage. The oversampling factors are integers, so this is
+    // what QImage::scaled with Qt::FastTransformation would produce, but without reallocating and
+    // scaling the whole image:
+    const int xFactor = keyAxis->orientation() == Qt::Horizontal ? keyOversamplingFactor : valueOversamplingFactor;
+    const int yFactor = keyAxis->orientation() == Qt::Horizontal ? valueOversamplingFactor : keyOversamplingFactor;
+    for (int y=updatedRect.top(); y<=updatedRect.bottom(); ++y)
+    {
+      const QRgb *source = reinterpret_cast<const QRgb*>(mUndersampledMapImage.constScanLine(y));
+      QRgb *target = reinterpret_cast<QRgb*>(mMapImage.scanLine(y*yFactor));
+      for (int x=updatedRect.left(); x<=updatedRect.right(); ++x)
+      {
+        for (int i=0; i<xFactor; ++i)
+          target[x*xFactor+i] = source[x];
+      }
+      const int targetBytes = updatedRect.width()*xFactor*sizeof(QRgb);
+      const int targetOffset = updatedRect.left()*xFactor*sizeof(QRgb);
+      for (int i=1; i<yFactor; ++i)
+        memcpy(mMapImage.scanLine(y*yFactor+i)+targetOffset, mMapImage.constScanLine(y*yFactor)+targetOffset, targetBytes);
+    }
   }
   mMapData->mDataModified = false;
+  mMapData->mModifiedFirst = 0;
+  mMapData->mModifiedLast = -1;
+  mMapData->mScrolledRows = 0;
   mMapImageInvalidated = false;
+  mMapImageOrientation = keyAxis->orientation();
+}
+
+/*! \internal
+  
+  Moves the pixels of the map \a image by \a valuePixels towards lower value coordinates, i.e.
+  down for a horizontal key axis (\a keyOrientation) and to the left for a vertical one. The pixels
+  that are uncovered keep their old content, they belong to rows that are colorized anyway.
+  
+  Called by \ref updateMapImage to follow \ref QCPColorMapData::scrollValueRows.
+*/
+void QCPColorMap::scrollMapImage(QImage *image, int valuePixels, Qt::Orientation keyOrientation)
+{
+  if (keyOrientation == Qt::Horizontal)
+  {
+    // value rows are scanlines, counted from the bottom:
+    const int lineBytes = image->bytesPerLine();
+    const int keptLines = image->height()-valuePixels;
+    if (keptLines > 0)
+    {
+      uchar *bits = image->bits();
+      memmove(bits+lineBytes*valuePixels, bits, lineBytes*keptLines);
+    }
+  } else
+  {
+    // value rows are columns, counted from the left:
+    const int keptPixels = image->width()-valuePixels;
+    if (keptPixels > 0)
+    {
+      for (int y=0; y<image->height(); ++y)
+      {
+        QRgb *line = reinterpret_cast<QRgb*>(image->scanLine(y));
+        memmove(line, line+valuePixels, sizeof(QRgb)*keptPixels);
+      }
+    }
+  }
 }
 
 /* inherits documentation from base class */
@@ -20534,6 +22140,260 @@ QCPRange QCPColorMap::getValueRange(bool &foundRange, SignDomain inSignDomain) c
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////// QCPPersistenceMap
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*! \class QCPPersistenceMap
+  \brief A color map that accumulates many overlaid sweeps into a decaying hit-count histogram.
+  
+  This is the "phosphor" display of an analog oscilloscope: Every sweep passed to \ref addSweep
+  is rasterized into the cells of the map's \ref QCPColorMapData, incrementing each cell the trace
+  passes through by one. Before a sweep is added, all cells are multiplied by the \ref setDecay
+  factor, so traces that are seen often glow brightly while rare excursions fade away. Drawing
+  thousands of overlaid graphs would cost time proportional to the number of sweeps on every
+  replot, whereas this plottable costs one colorization of the grid, independent of how many sweeps
+  it has accumulated.
+  
+  The grid is configured with \ref setGrid. Keys of the samples passed to \ref addSweep are mapped
+  to the key cells, sample values to the value cells. Values outside the grid's value range are not
+  counted. With \ref setConnectSamples enabled (the default), consecutive samples are connected by
+  vertical spans of cells, so steep edges stay visible just as they would with a graph's line.
+  
+  A cell that is hit by every sweep converges to \ref saturation, which is a sensible upper bound
+  for \ref setDataRange. The gradient is initialized to \ref QCPColorGradient::gpHot and the data
+  range to [0, saturation].
+  
+  Everything else (gradient, color scale, interpolation, scale type) is configured as for a \ref
+  QCPColorMap.
+*/
+
+/*!
+  Constructs a persistence map with \a keyAxis and \a valueAxis. The grid has the default size of
+  a \ref QCPColorMap until \ref setGrid is called.
+*/
+QCPPersistenceMap::QCPPersistenceMap(QCPAxis *keyAxis, QCPAxis *valueAxis) :
+  QCPColorMap(keyAxis, valueAxis),
+  mDecay(0.9),
+  mConnectSamples(true)
+{
+  setGradient(QCPColorGradient::gpHot);
+  setDataRange(QCPRange(0, saturation()));
+}
+
+QCPPersistenceMap::~QCPPersistenceMap()
+{
+}
+
+/*!
+  Sets the factor by which all cells are multiplied before a new sweep is added. A \a factor of 0
+  shows only the last sweep, values close to 1 give long persistence. \a factor is clamped to the
+  range [0, 1]. A factor of 1 disables the decay, so cells count the hits of all sweeps since the
+  last \ref clearHits.
+  
+  \see saturation
+*/
+void QCPPersistenceMap::setDecay(double factor)
+{
+  mDecay = qBound(0.0, factor, 1.0);
+}
+
+/*!
+  Sets whether consecutive samples of a sweep are connected by vertical spans of cells. If
+  disabled, each sample only hits the single cell it falls into, which is what a dot-mode display
+  shows.
+*/
+void QCPPersistenceMap::setConnectSamples(bool enabled)
+{
+  mConnectSamples = enabled;
+}
+
+/*!
+  Resizes the histogram to \a keySize by \a valueSize cells covering \a keyRange and \a valueRange
+  in plot coordinates, and clears all hits.
+  
+  \see QCPColorMapData::setSize, QCPColorMapData::setRange
+*/
+void QCPPersistenceMap::setGrid(int keySize, int valueSize, const QCPRange &keyRange, const QCPRange &valueRange)
+{
+  mMapData->setSize(keySize, valueSize);
+  mMapData->setRange(keyRange, valueRange);
+  clearHits();
+}
+
+/*!
+  Accumulates one sweep of \a count samples given in \a values. Sample \a i is located at key \a
+  firstKey + \a i * \a keyStep. NaN samples are skipped and break the connection between their
+  neighbours.
+  
+  All cells are decayed by the \ref setDecay factor first, then every cell the sweep passes through
+  is incremented by one. Note that the buffered data bounds of the map data (see \ref
+  QCPColorMapData::recalculateDataBounds) are not maintained by this method.
+*/
+void QCPPersistenceMap::addSweep(const double *values, int count, double firstKey, double keyStep)
+{
+  if (mMapData->isEmpty() || !mMapData->mData || count <= 0)
+    return;
+  const int keySize = mMapData->mKeySize;
+  const QCPRange keyRange = mMapData->mKeyRange;
+  if (keyRange.size() == 0)
+    return;
+  
+  decayCells();
+  binValues(values, count);
+  
+  // sample i lies in key cell floor(firstColumn + i*columnStep), the same cell centering as in
+  // QCPColorMapData::setData:
+  const double keyScale = (keySize-1)/(keyRange.upper-keyRange.lower);
+  const double firstColumn = (firstKey-keyRange.lower)*keyScale + 0.5;
+  const double columnStep = keyStep*keyScale;
+  const int *bins = mValueBins.constData();
+  
+  bool haveColumn = false; // whether column/lowBin/highBin/previousBin describe a pending column
+  int column = 0, lowBin = 0, highBin = 0, previousBin = 0;
+  for (int i=0; i<count; ++i)
+  {
+    if (qIsNaN(values[i]))
+    {
+      if (haveColumn)
+        addColumnHits(column, lowBin, highBin);
+      haveColumn = false;
+      continue;
+    }
+    const double columnPos = qBound(-1.0, firstColumn + i*columnStep, (double)keySize);
+    const int sampleColumn = (int)(columnPos + 1.0) - 1; // floor for positions >= -1
+    const int bin = bins[i];
+    if (haveColumn && sampleColumn == column)
+    {
+      lowBin = qMin(lowBin, bin);
+      highBin = qMax(highBin, bin);
+    } else if (haveColumn && mConnectSamples)
+    {
+      addColumnHits(column, lowBin, highBin);
+      // connect to the previous sample, interpolating the columns in between if the sweep has fewer
+      // samples than the grid has columns:
+      const int distance = qAbs(sampleColumn-column);
+      const int direction = sampleColumn > column ? 1 : -1;
+      int from = previousBin;
+      for (int step=1; step<distance; ++step)
+      {
+        const int to = previousBin + (bin-previousBin)*step/distance;
+        addColumnHits(column+direction*step, qMin(from, to), qMax(from, to));
+        from = to;
+      }
+      column = sampleColumn;
+      lowBin = qMin(from, bin);
+      highBin = qMax(from, bin);
+    } else
+    {
+      if (haveColumn)
+        addColumnHits(column, lowBin, highBin);
+      column = sampleColumn;
+      lowBin = bin;
+      highBin = bin;
+      haveColumn = true;
+    }
+    previousBin = bin;
+  }
+  if (haveColumn)
+    addColumnHits(column, lowBin, highBin);
+  
+  // the decay touched every cell:
+  mMapData->markModified(0, mMapData->mValueSize-1);
+}
+
+/*! \overload
+  
+  Accumulates the sweep stored in \a values.
+*/
+void QCPPersistenceMap::addSweep(const QVector<double> &values, double firstKey, double keyStep)
+{
+  addSweep(values.constData(), values.size(), firstKey, keyStep);
+}
+
+/*!
+  Sets all cells of the histogram to zero, keeping the grid size and ranges.
+*/
+void QCPPersistenceMap::clearHits()
+{
+  if (!mMapData->isEmpty() && mMapData->mData)
+    mMapData->fill(0);
+}
+
+/*!
+  Returns the value a cell converges to if it is hit by every sweep, 1/(1-decay). If the decay is
+  disabled (a factor of 1), there is no such limit and infinity is returned.
+  
+  \see setDecay
+*/
+double QCPPersistenceMap::saturation() const
+{
+  if (mDecay >= 1.0)
+    return std::numeric_limits<double>::infinity();
+  return 1.0/(1.0-mDecay);
+}
+
+/*! \internal
+  
+  Multiplies all cells by the decay factor. The grid is a plain contiguous array, so this loop is
+  vectorized by the compiler.
+*/
+void QCPPersistenceMap::decayCells()
+{
+  if (mDecay >= 1.0)
+    return;
+  double *cells = mMapData->mData;
+  const double decay = mDecay;
+  const int cellCount = mMapData->mKeySize*mMapData->mValueSize;
+  for (int i=0; i<cellCount; ++i)
+    cells[i] *= decay;
+}
+
+/*! \internal
+  
+  Transforms the \a count samples in \a values to value cell indices in \ref mValueBins. Values
+  below the value range map to -1, values above it (and NaN) to the value size. The loop is free of
+  branches and function calls, so it is vectorized by the compiler.
+*/
+void QCPPersistenceMap::binValues(const double *values, int count)
+{
+  const int valueSize = mMapData->mValueSize;
+  const QCPRange valueRange = mMapData->mValueRange;
+  const double valueScale = (valueSize-1)/(valueRange.upper-valueRange.lower);
+  const double valueOffset = 0.5 - valueRange.lower*valueScale + 1.0; // +1 so the truncation below is a floor for positions >= -1
+  const double maxPos = valueSize + 1.0;
+  
+  mValueBins.resize(count);
+  int *bins = mValueBins.data();
+  for (int i=0; i<count; ++i)
+  {
+    double pos = values[i]*valueScale + valueOffset;
+    pos = pos < maxPos ? pos : maxPos; // NaN compares false and ends up at maxPos as well
+    pos = pos > 0.0 ? pos : 0.0;
+    bins[i] = (int)pos - 1;
+  }
+}
+
+/*! \internal
+  
+  Increments the cells of key cell \a column from value cell \a lowBin to \a highBin (inclusive)
+  by one. Spans that lie entirely outside the grid are ignored, spans that cross its border are
+  clipped.
+*/
+void QCPPersistenceMap::addColumnHits(int column, int lowBin, int highBin)
+{
+  const int keySize = mMapData->mKeySize;
+  const int valueSize = mMapData->mValueSize;
+  if (column < 0 || column >= keySize || highBin < 0 || lowBin >= valueSize)
+    return;
+  lowBin = qMax(lowBin, 0);
+  highBin = qMin(highBin, valueSize-1);
+  double *cell = mMapData->mData + lowBin*keySize + column;
+  for (int bin=lowBin; bin<=highBin; ++bin, cell+=keySize)
+    *cell += 1.0;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //////////////////// QCPFinancialData
 ////////////////////////////////////////////////////////////////////////////////////////////////////
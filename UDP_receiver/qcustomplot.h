@@ -43,8 +43,13 @@
 #include <QStack>
 #include <QCache>
 #include <QMargins>
+#include <QImage>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
 #include <qmath.h>
 #include <limits>
+#include <algorithm>
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 #  include <qnumeric.h>
 #  include <QPrinter>
@@ -73,6 +78,7 @@ class QCPAbstractLegendItem;
 class QCPColorMap;
 class QCPColorScale;
 class QCPBars;
+class QCPRenderThread;
 
 
 /*! \file */
@@ -321,6 +327,7 @@ public:
                      ,pmVectorized   = 0x01   ///< <tt>0x01</tt> Mode for vectorized painting (e.g. PDF export). For example, this prevents some antialiasing fixes.
                      ,pmNoCaching    = 0x02   ///< <tt>0x02</tt> Mode for all sorts of exports (e.g. PNG, PDF,...). For example, this prevents using cached pixmap labels
                      ,pmNonCosmetic  = 0x04   ///< <tt>0x04</tt> Turns pen widths 0 to 1, i.e. disables cosmetic pens. (A cosmetic pen is always drawn with width 1 pixel in the vector image/pdf viewer, independent of zoom.)
+                     ,pmNoPixmaps    = 0x08   ///< <tt>0x08</tt> Mode for painting outside the GUI thread, where QPixmaps must not be created. For example, this prevents using cached pixmap labels
                    };
   Q_FLAGS(PainterMode PainterModes)
   Q_DECLARE_FLAGS(PainterModes, PainterMode)
@@ -371,6 +378,7 @@ class QCP_LIB_DECL QCPLayer : public QObject
   Q_PROPERTY(int index READ index)
   Q_PROPERTY(QList<QCPLayerable*> children READ children)
   Q_PROPERTY(bool visible READ visible WRITE setVisible)
+  Q_PROPERTY(bool cached READ cached WRITE setCached)
   /// \endcond
 public:
   QCPLayer(QCustomPlot* parentPlot, const QString &layerName);
@@ -382,9 +390,14 @@ public:
   int index() const { return mIndex; }
   QList<QCPLayerable*> children() const { return mChildren; }
   bool visible() const { return mVisible; }
+  bool cached() const { return mCached; }
   
   // setters:
   void setVisible(bool visible);
+  void setCached(bool enabled);
+  
+  // non-property methods:
+  void markDirty();
   
 protected:
   // property members:
@@ -393,10 +406,19 @@ protected:
   int mIndex;
   QList<QCPLayerable*> mChildren;
   bool mVisible;
+  bool mCached;
+  
+  // non-property members:
+  QImage mCache;
+  bool mCacheValid;
+  quint64 mCacheSignature;
   
   // non-virtual methods:
   void addChild(QCPLayerable *layerable, bool prepend);
   void removeChild(QCPLayerable *layerable);
+  void draw(QCPPainter *painter);
+  void drawChildren(QCPPainter *painter);
+  quint64 cacheSignature(const QSize &size) const;
   
 private:
   Q_DISABLE_COPY(QCPLayer)
@@ -1279,6 +1301,23 @@ protected:
   QVector<double> mSubTickVector;
   bool mCachedMarginValid;
   int mCachedMargin;
+  struct TickSetup
+  {
+    QCPRange range;
+    ScaleType scaleType;
+    double scaleLogBase;
+    double tickStep;
+    int autoTickCount, subTickCount;
+    LabelType tickLabelType;
+    QChar numberFormatChar;
+    bool numberBeautifulPowers;
+    int numberPrecision;
+    QString dateTimeFormat;
+    Qt::TimeSpec dateTimeSpec;
+    QLocale locale;
+    bool visible;
+  } mTickSetup;
+  bool mTickSetupValid;
   
   // introduced virtual methods:
   virtual void setupTickVectors();
@@ -1295,6 +1334,7 @@ protected:
   virtual void deselectEvent(bool *selectionStateChanged);
   
   // non-virtual methods:
+  bool updateTickSetup();
   void visibleTickBounds(int &lowIndex, int &highIndex) const;
   double baseLog(double value) const;
   double basePow(double value) const;
@@ -1690,6 +1730,7 @@ class QCP_LIB_DECL QCustomPlot : public QWidget
   Q_PROPERTY(int selectionTolerance READ selectionTolerance WRITE setSelectionTolerance)
   Q_PROPERTY(bool noAntialiasingOnDrag READ noAntialiasingOnDrag WRITE setNoAntialiasingOnDrag)
   Q_PROPERTY(Qt::KeyboardModifier multiSelectModifier READ multiSelectModifier WRITE setMultiSelectModifier)
+  Q_PROPERTY(bool threadedRendering READ threadedRendering WRITE setThreadedRendering)
   /// \endcond
 public:
   /*!
@@ -1729,6 +1770,7 @@ public:
   bool noAntialiasingOnDrag() const { return mNoAntialiasingOnDrag; }
   QCP::PlottingHints plottingHints() const { return mPlottingHints; }
   Qt::KeyboardModifier multiSelectModifier() const { return mMultiSelectModifier; }
+  bool threadedRendering() const { return mRenderThread != 0; }
 
   // setters:
   void setViewport(const QRect &rect);
@@ -1749,8 +1791,12 @@ public:
   void setPlottingHints(const QCP::PlottingHints &hints);
   void setPlottingHint(QCP::PlottingHint hint, bool enabled=true);
   void setMultiSelectModifier(Qt::KeyboardModifier modifier);
+  void setThreadedRendering(bool enabled);
   
   // non-property methods:
+  bool isRendering() const;
+  void waitForRender();
+  
   // plottable interface:
   QCPAbstractPlottable *plottable(int index);
   QCPAbstractPlottable *plottable();
@@ -1868,6 +1914,10 @@ protected:
   QPoint mMousePressPos;
   QPointer<QCPLayoutElement> mMouseEventElement;
   bool mReplotting;
+  QCPRenderThread *mRenderThread;
+  QImage mRenderedFrame;
+  bool mReplotPending;
+  RefreshPriority mRenderRefreshPriority;
   
   // reimplemented virtual methods:
   virtual QSize minimumSizeHint() const;
@@ -1889,11 +1939,39 @@ protected:
   void updateLayerIndices() const;
   QCPLayerable *layerableAt(const QPointF &pos, bool onlySelectable, QVariant *selectionDetails=0) const;
   void drawBackground(QCPPainter *painter);
+  void updateLayout();
+  void drawLayers(QCPPainter *painter);
+  void refresh(RefreshPriority refreshPriority);
+  Q_SLOT void renderFinished();
   
   friend class QCPLegend;
   friend class QCPAxis;
   friend class QCPLayer;
   friend class QCPAxisRect;
+  friend class QCPRenderThread;
+};
+
+
+class QCP_LIB_DECL QCPRenderThread : public QThread
+{
+public:
+  explicit QCPRenderThread(QCustomPlot *parentPlot);
+  virtual ~QCPRenderThread();
+  
+  bool isBusy() const;
+  void render(const QSize &size);
+  void waitForPainting();
+  void takeFrame(QImage &frame);
+  
+protected:
+  QCustomPlot *mParentPlot;
+  mutable QMutex mMutex;
+  QWaitCondition mRequested, mPainted;
+  QImage mFrame;
+  QSize mSize;
+  bool mBusy, mPainting, mStop;
+  
+  virtual void run();
 };
 
 
@@ -2475,16 +2553,140 @@ public:
 };
 Q_DECLARE_TYPEINFO(QCPData, Q_MOVABLE_TYPE);
 
+class QCP_LIB_DECL QCPDataContainer
+{
+public:
+  class iterator
+  {
+  public:
+    iterator() : d(0) {}
+    explicit iterator(QCPData *data) : d(data) {}
+    double key() const { return d->key; }
+    QCPData &value() const { return *d; }
+    QCPData &operator*() const { return *d; }
+    QCPData *operator->() const { return d; }
+    iterator &operator++() { ++d; return *this; }
+    iterator operator++(int) { iterator it(*this); ++d; return it; }
+    iterator &operator--() { --d; return *this; }
+    iterator operator--(int) { iterator it(*this); --d; return it; }
+    iterator &operator+=(int j) { d += j; return *this; }
+    iterator &operator-=(int j) { d -= j; return *this; }
+    iterator operator+(int j) const { return iterator(d+j); }
+    iterator operator-(int j) const { return iterator(d-j); }
+    int operator-(const iterator &other) const { return int(d-other.d); }
+    bool operator==(const iterator &other) const { return d == other.d; }
+    bool operator!=(const iterator &other) const { return d != other.d; }
+    bool operator<(const iterator &other) const { return d < other.d; }
+    QCPData *d;
+  };
+  
+  class const_iterator
+  {
+  public:
+    const_iterator() : d(0) {}
+    explicit const_iterator(const QCPData *data) : d(data) {}
+    const_iterator(const iterator &it) : d(it.d) {}
+    double key() const { return d->key; }
+    const QCPData &value() const { return *d; }
+    const QCPData &operator*() const { return *d; }
+    const QCPData *operator->() const { return d; }
+    const_iterator &operator++() { ++d; return *this; }
+    const_iterator operator++(int) { const_iterator it(*this); ++d; return it; }
+    const_iterator &operator--() { --d; return *this; }
+    const_iterator operator--(int) { const_iterator it(*this); --d; return it; }
+    const_iterator &operator+=(int j) { d += j; return *this; }
+    const_iterator &operator-=(int j) { d -= j; return *this; }
+    const_iterator operator+(int j) const { return const_iterator(d+j); }
+    const_iterator operator-(int j) const { return const_iterator(d-j); }
+    int operator-(const const_iterator &other) const { return int(d-other.d); }
+    bool operator==(const const_iterator &other) const { return d == other.d; }
+    bool operator!=(const const_iterator &other) const { return d != other.d; }
+    bool operator<(const const_iterator &other) const { return d < other.d; }
+    const QCPData *d;
+  };
+  
+  QCPDataContainer();
+  
+  // QMap compatible interface:
+  int size() const { return mData.size(); }
+  int count() const { return mData.size(); }
+  bool isEmpty() const { return mData.isEmpty(); }
+  void clear() { mData.resize(0); mUnchangedPrefix = 0; }
+  iterator begin() { mUnchangedPrefix = 0; return iterator(mData.data()); }
+  iterator end() { mUnchangedPrefix = 0; return iterator(mData.data()+mData.size()); }
+  const_iterator begin() const { return constBegin(); }
+  const_iterator end() const { return constEnd(); }
+  const_iterator constBegin() const { return const_iterator(mData.constData()); }
+  const_iterator constEnd() const { return const_iterator(mData.constData()+mData.size()); }
+  iterator lowerBound(double key);
+  iterator upperBound(double key);
+  const_iterator lowerBound(double key) const;
+  const_iterator upperBound(double key) const;
+  iterator insertMulti(double key, const QCPData &data);
+  void unite(const QCPDataContainer &other);
+  iterator erase(iterator it);
+  iterator erase(iterator first, iterator last);
+  int remove(double key);
+  
+  // bulk interface:
+  void reserve(int size) { mData.reserve(size); }
+  void set(const QVector<double> &keys, const QVector<double> &values);
+  void add(const QVector<double> &keys, const QVector<double> &values);
+  void adopt(QVector<QCPData> &data, bool alreadySorted=false);
+  const QVector<QCPData> &vector() const { return mData; }
+  
+  // change tracking, for QCPMinMaxPyramid:
+  int unchangedPrefix() const { return mUnchangedPrefix; }
+  void resetUnchangedPrefix() { mUnchangedPrefix = mData.size(); }
+  
+protected:
+  QVector<QCPData> mData;
+  int mUnchangedPrefix;
+  
+  void sort(int sortedPrefix=0);
+};
+
 /*! \typedef QCPDataMap
-  Container for storing \ref QCPData items in a sorted fashion. The key of the map
-  is the key member of the QCPData instance.
+  Container for storing \ref QCPData items in a sorted fashion, ordered by the key member of
+  the QCPData instances. It is a \ref QCPDataContainer, which keeps the points in one contiguous
+  array and offers the parts of the QMap interface QCustomPlot uses.
   
   This is the container in which QCPGraph holds its data.
   \see QCPData, QCPGraph::setData
 */
-typedef QMap<double, QCPData> QCPDataMap;
-typedef QMapIterator<double, QCPData> QCPDataMapIterator;
-typedef QMutableMapIterator<double, QCPData> QCPDataMutableMapIterator;
+typedef QCPDataContainer QCPDataMap;
+
+
+class QCP_LIB_DECL QCPMinMaxPyramid
+{
+public:
+  struct Bucket
+  {
+    float min, max; // NaN if the bucket holds no values
+    quint32 minOffset, maxOffset; // where min and max are, counted from the first index of the bucket
+  };
+  
+  QCPMinMaxPyramid();
+  
+  int levelCount() const { return mLevels.size(); }
+  int bucketSize(int level) const { return 2<<level; }
+  const Bucket &bucket(int level, quint64 index) const;
+  int levelFor(double pointsPerBucket) const;
+  
+  void clear();
+  void update(const QCPDataContainer &data);
+  void update(const double *ring, int capacity, quint64 begin, quint64 end);
+  void update(const float *ring, int capacity, quint64 begin, quint64 end);
+  
+protected:
+  QVector<QVector<Bucket> > mLevels;
+  int mWindow;
+  quint64 mEnd;
+  
+  void setWindow(int window);
+  quint64 prepareRing(int capacity, quint64 begin, quint64 end);
+  template <class ValueAt> void updateBuckets(const ValueAt &valueAt, quint64 begin, quint64 end, quint64 from);
+};
 
 
 class QCP_LIB_DECL QCPGraph : public QCPAbstractPlottable
@@ -2499,6 +2701,7 @@ class QCP_LIB_DECL QCPGraph : public QCPAbstractPlottable
   Q_PROPERTY(bool errorBarSkipSymbol READ errorBarSkipSymbol WRITE setErrorBarSkipSymbol)
   Q_PROPERTY(QCPGraph* channelFillGraph READ channelFillGraph WRITE setChannelFillGraph)
   Q_PROPERTY(bool adaptiveSampling READ adaptiveSampling WRITE setAdaptiveSampling)
+  Q_PROPERTY(bool minMaxPyramid READ minMaxPyramid WRITE setMinMaxPyramid)
   /// \endcond
 public:
   /*!
@@ -2538,10 +2741,12 @@ public:
   bool errorBarSkipSymbol() const { return mErrorBarSkipSymbol; }
   QCPGraph *channelFillGraph() const { return mChannelFillGraph.data(); }
   bool adaptiveSampling() const { return mAdaptiveSampling; }
+  bool minMaxPyramid() const { return mMinMaxPyramid; }
   
   // setters:
   void setData(QCPDataMap *data, bool copy=false);
   void setData(const QVector<double> &key, const QVector<double> &value);
+  void adoptData(QVector<QCPData> &data, bool alreadySorted=false);
   void setDataKeyError(const QVector<double> &key, const QVector<double> &value, const QVector<double> &keyError);
   void setDataKeyError(const QVector<double> &key, const QVector<double> &value, const QVector<double> &keyErrorMinus, const QVector<double> &keyErrorPlus);
   void setDataValueError(const QVector<double> &key, const QVector<double> &value, const QVector<double> &valueError);
@@ -2556,6 +2761,7 @@ public:
   void setErrorBarSkipSymbol(bool enabled);
   void setChannelFillGraph(QCPGraph *targetGraph);
   void setAdaptiveSampling(bool enabled);
+  void setMinMaxPyramid(bool enabled);
   
   // non-property methods:
   void addData(const QCPDataMap &dataMap);
@@ -2588,6 +2794,10 @@ protected:
   bool mErrorBarSkipSymbol;
   QPointer<QCPGraph> mChannelFillGraph;
   bool mAdaptiveSampling;
+  bool mMinMaxPyramid;
+  
+  // non-property members:
+  mutable QCPMinMaxPyramid mPyramid;
   
   // reimplemented virtual methods:
   virtual void draw(QCPPainter *painter);
@@ -2605,6 +2815,7 @@ protected:
   
   // non-virtual methods:
   void getPreparedData(QVector<QCPData> *lineData, QVector<QCPData> *scatterData) const;
+  void getPyramidLineData(QVector<QCPData> *lineData, const QCPDataMap::const_iterator &lower, const QCPDataMap::const_iterator &upper, int keyPixelSpan) const;
   void getPlotData(QVector<QPointF> *lineData, QVector<QCPData> *scatterData) const;
   void getScatterPlotData(QVector<QCPData> *scatterData) const;
   void getLinePlotData(QVector<QPointF> *linePixelData, QVector<QCPData> *scatterData) const;
@@ -2631,6 +2842,81 @@ protected:
 };
 
 
+class QCP_LIB_DECL QCPStreamSource
+{
+public:
+  virtual ~QCPStreamSource() {}
+  
+  virtual quint64 sampleCount() const = 0;
+  virtual int capacity() const = 0;
+  virtual quint64 writePosition() const { return sampleCount(); }
+  virtual bool isIntact(quint64 begin) const { return writePosition()-begin <= quint64(capacity()); }
+  virtual const double *buffer() const { return 0; }
+  virtual const float *floatBuffer() const { return 0; }
+};
+
+
+class QCP_LIB_DECL QCPStreamGraph : public QCPAbstractPlottable
+{
+  Q_OBJECT
+  /// \cond INCLUDE_QPROPERTIES
+  Q_PROPERTY(double samplePeriod READ samplePeriod WRITE setSamplePeriod)
+  Q_PROPERTY(double keyOffset READ keyOffset WRITE setKeyOffset)
+  Q_PROPERTY(int scrollWindow READ scrollWindow WRITE setScrollWindow)
+  /// \endcond
+public:
+  explicit QCPStreamGraph(QCPAxis *keyAxis, QCPAxis *valueAxis);
+  virtual ~QCPStreamGraph();
+  
+  // getters:
+  QCPStreamSource *source() const { return mSource; }
+  double samplePeriod() const { return mSamplePeriod; }
+  double keyOffset() const { return mKeyOffset; }
+  int scrollWindow() const { return mScrollWindow; }
+  
+  // setters:
+  void setSource(QCPStreamSource *source);
+  void setSamplePeriod(double period);
+  void setKeyOffset(double offset);
+  void setScrollWindow(int samples);
+  
+  // non-property methods:
+  double sampleKey(quint64 index) const;
+  
+  // reimplemented virtual methods:
+  virtual void clearData();
+  virtual double selectTest(const QPointF &pos, bool onlySelectable, QVariant *details=0) const;
+  
+protected:
+  // property members:
+  QCPStreamSource *mSource;
+  double mSamplePeriod;
+  double mKeyOffset;
+  int mScrollWindow;
+  
+  // non-property members:
+  QCPMinMaxPyramid mPyramid;
+  QVector<QPointF> mLineData;
+  
+  // reimplemented virtual methods:
+  virtual void draw(QCPPainter *painter);
+  virtual void drawLegendIcon(QCPPainter *painter, const QRectF &rect) const;
+  virtual QCPRange getKeyRange(bool &foundRange, SignDomain inSignDomain=sdBoth) const;
+  virtual QCPRange getValueRange(bool &foundRange, SignDomain inSignDomain=sdBoth) const;
+  
+  // non-virtual methods:
+  double indexToKey(quint64 index, double origin) const;
+  bool retainedRange(quint64 &begin, quint64 &end) const;
+  void updatePyramid(quint64 begin, quint64 end);
+  void getLineData(QVector<QPointF> *lineData, quint64 begin, quint64 end) const;
+  template <typename Sample> QCPRange getRingValueRange(const Sample *ring, quint64 begin, quint64 end, SignDomain inSignDomain, bool &foundRange) const;
+  template <typename Sample> void getRingLineData(QVector<QPointF> *lineData, const Sample *ring, quint64 begin, quint64 end, double origin) const;
+  
+  friend class QCustomPlot;
+  friend class QCPLegend;
+};
+
+
 /*! \file */
 
 
@@ -3025,6 +3311,7 @@ public:
   void recalculateDataBounds();
   void clear();
   void fill(double z);
+  void scrollValueRows(int rows);
   bool isEmpty() const { return mIsEmpty; }
   void coordToCell(double key, double value, int *keyIndex, int *valueIndex) const;
   void cellToCoord(int keyIndex, int valueIndex, double *key, double *value) const;
@@ -3038,8 +3325,14 @@ protected:
   double *mData;
   QCPRange mDataBounds;
   bool mDataModified;
+  int mModifiedFirst, mModifiedLast;
+  int mScrolledRows;
+  
+  // non-virtual methods:
+  void markModified(int firstValueIndex, int lastValueIndex);
   
   friend class QCPColorMap;
+  friend class QCPPersistenceMap;
 };
 
 
@@ -3102,6 +3395,7 @@ protected:
   QImage mMapImage, mUndersampledMapImage;
   QPixmap mLegendIcon;
   bool mMapImageInvalidated;
+  Qt::Orientation mMapImageOrientation;
   
   // introduced virtual methods:
   virtual void updateMapImage();
@@ -3112,11 +3406,54 @@ protected:
   virtual QCPRange getKeyRange(bool &foundRange, SignDomain inSignDomain=sdBoth) const;
   virtual QCPRange getValueRange(bool &foundRange, SignDomain inSignDomain=sdBoth) const;
   
+  // non-virtual methods:
+  void scrollMapImage(QImage *image, int valuePixels, Qt::Orientation keyOrientation);
+  
   friend class QCustomPlot;
   friend class QCPLegend;
 };
 
 
+class QCP_LIB_DECL QCPPersistenceMap : public QCPColorMap
+{
+  Q_OBJECT
+  /// \cond INCLUDE_QPROPERTIES
+  Q_PROPERTY(double decay READ decay WRITE setDecay)
+  Q_PROPERTY(bool connectSamples READ connectSamples WRITE setConnectSamples)
+  /// \endcond
+public:
+  explicit QCPPersistenceMap(QCPAxis *keyAxis, QCPAxis *valueAxis);
+  virtual ~QCPPersistenceMap();
+  
+  // getters:
+  double decay() const { return mDecay; }
+  bool connectSamples() const { return mConnectSamples; }
+  
+  // setters:
+  void setDecay(double factor);
+  void setConnectSamples(bool enabled);
+  
+  // non-property methods:
+  void setGrid(int keySize, int valueSize, const QCPRange &keyRange, const QCPRange &valueRange);
+  void addSweep(const double *values, int count, double firstKey, double keyStep);
+  void addSweep(const QVector<double> &values, double firstKey, double keyStep);
+  void clearHits();
+  double saturation() const;
+  
+protected:
+  // property members:
+  double mDecay;
+  bool mConnectSamples;
+  // non-property members:
+  QVector<int> mValueBins;
+  
+  // non-virtual methods:
+  void decayCells();
+  void binValues(const double *values, int count);
+  void addColumnHits(int column, int lowBin, int highBin);
+};
+
+
 /*! \file */
 
 
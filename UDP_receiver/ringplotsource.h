@@ -0,0 +1,47 @@
+#ifndef RINGPLOTSOURCE_H
+#define RINGPLOTSOURCE_H
+
+#include "qcustomplot.h"
+#include "samplering.h"
+
+/*
+ * Lets a QCPStreamGraph plot a SampleRing<DspSample> in place, whether
+ * the samples are doubles or floats.
+ *
+ * The end of the stream is pinned with setEnd() instead of following the
+ * ring's write position, so that several graphs fed by the same producer
+ * show the same span of samples even while the producer keeps writing.
+ * The graph still measures how much of the ring it may read against the
+ * producer's live position, and drops a frame the producer overtook.
+ */
+class RingPlotSource : public QCPStreamSource
+{
+public:
+	explicit RingPlotSource(const SampleRing<DspSample> &ring)
+		: m_ring(ring)
+		, m_end(0)
+	{
+	}
+
+	// GUI side: samples up to (not including) end are plotted.
+	void setEnd(quint64 end) { m_end = end; }
+
+	quint64 sampleCount() const Q_DECL_OVERRIDE { return m_end; }
+	int capacity() const Q_DECL_OVERRIDE { return m_ring.capacity(); }
+	quint64 writePosition() const Q_DECL_OVERRIDE { return m_ring.claimed(); }
+	bool isIntact(quint64 begin) const Q_DECL_OVERRIDE { return m_ring.isIntact(begin); }
+	const double *buffer() const Q_DECL_OVERRIDE { return doubles(m_ring.data()); }
+	const float *floatBuffer() const Q_DECL_OVERRIDE { return floats(m_ring.data()); }
+
+private:
+	// the ring's storage if it holds that type, else 0
+	static const double *doubles(const double *data) { return data; }
+	static const double *doubles(const float *) { return 0; }
+	static const float *floats(const float *data) { return data; }
+	static const float *floats(const double *) { return 0; }
+
+	const SampleRing<DspSample> &m_ring;
+	quint64 m_end;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/*
+ * Sample type of the receive chain, from the ingest rings through the
+ * DSP stages to the plots. The samples are millivolts from an 8 to 12 bit
+ * ADC, so single precision loses nothing that matters and halves the
+ * memory traffic of every ring; build with CONFIG+=float_samples to use
+ * it. Filter recursions keep their state in double either way.
+ */
+#ifdef RECEIVER_FLOAT_SAMPLES
+typedef float DspSample;
+#else
+typedef double DspSample;
+#endif
+
+/*
+ * Fixed-capacity single-producer/single-consumer ring of samples.
+ *
+ * The producer (the network side) appends with push() and never blocks or
+ * takes a lock; once the ring is full the oldest samples are overwritten.
+ * The consumer (the plot side) asks for a View of the latest N samples,
+ * which points straight into the ring storage instead of copying it.
+ *
+ * Samples are addressed by an absolute, ever increasing 64 bit index. Slots
+ * that have never been written read as zero, so a View of the full window
+ * is valid from the very first frame.
+ *
+ * Before it copies anything, push() claims the slots it is about to write
+ * (m_claim); only after the copy does it publish them (m_head). A consumer
+ * that read a View checks it against the claim, so a View the producer is
+ * overwriting at that moment counts as torn even though m_head has not
+ * moved past it yet.
+ */
+template <typename T>
+class SampleRing
+{
+public:
+	enum { CacheLine = 64 };
+
+	// Up to two contiguous pieces of the ring, oldest sample first.
+	struct View
+	{
+		const T *first;
+		int firstCount;
+		const T *second;
+		int secondCount;
+		uint64_t start;	// absolute index of the first sample in the view
+
+		int size() const { return firstCount + secondCount; }
+
+		const T &operator[](int i) const
+		{
+			return i < firstCount ? first[i] : second[i - firstCount];
+		}
+
+		void copyTo(T *dest) const
+		{
+			memcpy(dest, first, firstCount * sizeof(T));
+			memcpy(dest + firstCount, second, secondCount * sizeof(T));
+		}
+
+		// As above, converting to another sample type.
+		template <typename U>
+		void copyTo(U *dest) const
+		{
+			for (int i = 0; i < firstCount; ++i)
+				dest[i] = U(first[i]);
+			for (int i = 0; i < secondCount; ++i)
+				dest[firstCount + i] = U(second[i]);
+		}
+	};
+
+	explicit SampleRing(int capacityLog2 = 18)
+		: m_capacity(1 << capacityLog2)
+		, m_mask((1 << capacityLog2) - 1)
+		, m_head(0)
+		, m_claim(0)
+	{
+		void *p = 0;
+		if (posix_memalign(&p, CacheLine, m_capacity * sizeof(T)) != 0)
+			throw std::bad_alloc();
+		m_data = static_cast<T*>(p);
+		memset(m_data, 0, m_capacity * sizeof(T));
+	}
+
+	~SampleRing()
+	{
+		free(m_data);
+	}
+
+	int capacity() const { return m_capacity; }
+
+	// Ring storage: the sample with absolute index i is at data()[i & (capacity() - 1)].
+	const T *data() const { return m_data; }
+
+	// Total number of samples pushed so far (consumer side).
+	uint64_t written() const { return m_head.load(std::memory_order_acquire); }
+
+	// Samples written so far plus those a push() in progress is writing.
+	uint64_t claimed() const { return m_claim.load(std::memory_order_relaxed); }
+
+	// Producer side only.
+	void push(T value)
+	{
+		const uint64_t head = m_head.load(std::memory_order_relaxed);
+		claim(head + 1);
+		m_data[head & m_mask] = value;
+		m_head.store(head + 1, std::memory_order_release);
+	}
+
+	// Producer side only. count must not exceed capacity().
+	void push(const T *src, int count)
+	{
+		const uint64_t head = m_head.load(std::memory_order_relaxed);
+		claim(head + count);
+		const int offset = int(head & m_mask);
+		const int firstCount = count < m_capacity - offset ? count : m_capacity - offset;
+		memcpy(m_data + offset, src, firstCount * sizeof(T));
+		memcpy(m_data, src + firstCount, (count - firstCount) * sizeof(T));
+		m_head.store(head + count, std::memory_order_release);
+	}
+
+	// Producer side only. As above, converting from another sample type on
+	// the way in.
+	template <typename U>
+	void push(const U *src, int count)
+	{
+		const uint64_t head = m_head.load(std::memory_order_relaxed);
+		claim(head + count);
+		const int offset = int(head & m_mask);
+		const int firstCount = count < m_capacity - offset ? count : m_capacity - offset;
+		T *dest = m_data + offset;
+		for (int i = 0; i < firstCount; ++i)
+			dest[i] = T(src[i]);
+		for (int i = firstCount; i < count; ++i)
+			m_data[i - firstCount] = T(src[i]);
+		m_head.store(head + count, std::memory_order_release);
+	}
+
+	// Consumer side. Zero-copy view of the latest count samples
+	// (count must not exceed capacity()).
+	View latest(int count) const
+	{
+		return range(written() - count, count);
+	}
+
+	// Consumer side. Zero-copy view of count samples starting at the
+	// absolute index start.
+	View range(uint64_t start, int count) const
+	{
+		View v;
+		const int offset = int(start & m_mask);
+		v.start = start;
+		v.first = m_data + offset;
+		v.firstCount = count < m_capacity - offset ? count : m_capacity - offset;
+		v.second = m_data;
+		v.secondCount = count - v.firstCount;
+		return v;
+	}
+
+	// Consumer side. True if the producer has not overwritten, and is not
+	// overwriting, any part of v; call after reading the view to detect a
+	// torn read.
+	bool isIntact(const View &v) const
+	{
+		return isIntact(v.start);
+	}
+
+	// Consumer side. As above, for everything read from the absolute
+	// index start on.
+	bool isIntact(uint64_t start) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return claimed() - start <= uint64_t(m_capacity);
+	}
+
+private:
+	SampleRing(const SampleRing &);
+	SampleRing &operator=(const SampleRing &);
+
+	// Announces that the slots up to end are about to be overwritten. The
+	// fence keeps the claim ahead of the stores into the slots, so a reader
+	// that saw any of those stores sees the claim after its acquire fence.
+	void claim(uint64_t end)
+	{
+		m_claim.store(end, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	T *m_data;
+	const int m_capacity;
+	const int m_mask;
+	// Kept on its own cache line so the producer's stores do not
+	// invalidate the line holding m_data/m_mask on the consumer side.
+	alignas(CacheLine) std::atomic<uint64_t> m_head;
+	std::atomic<uint64_t> m_claim;
+	char m_pad[CacheLine - 2 * sizeof(std::atomic<uint64_t>)];
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include <cmath>
+#include <qmath.h>
+
+#include "spectrogram.h"
+
+Spectrogram::Spectrogram(int fftSize, int hop, int decimation)
+	: m_fftSize(fftSize)
+	, m_hop(hop)
+	, m_decimation(decimation)
+	, m_sum(0)
+	, m_summed(0)
+	, m_history(fftSize)
+	, m_historyPos(0)
+	, m_sinceFrame(0)
+	, m_window(fftSize)
+	, m_fft(fftSize)
+	, m_frame(fftSize)
+	, m_re(fftSize / 2 + 1)
+	, m_im(fftSize / 2 + 1)
+	, m_column(fftSize / 2 + 1)
+{
+	// periodic Hann window; a full-scale sine of amplitude A reads
+	// A * A / 4 in its bin after scaling by 1 / (sum of the window)^2
+	double windowSum = 0;
+	for (int i = 0; i < fftSize; ++i)
+	{
+		m_window[i] = 0.5 - 0.5 * qCos(2 * M_PI * i / fftSize);
+		windowSum += m_window[i];
+	}
+	m_powerScale = 1.0 / (windowSum * windowSum);
+}
+
+void Spectrogram::setDecimation(int decimation)
+{
+	m_decimation = decimation;
+	m_sum = 0;
+	m_summed = 0;
+}
+
+double Spectrogram::binFrequency(int bin, double sampleRate) const
+{
+	return bin * sampleRate / (double(m_decimation) * m_fftSize);
+}
+
+template <typename Sample>
+int Spectrogram::process(const Sample *samples, int count, SampleRing<Sample> &out)
+{
+	int columns = 0;
+	double *history = m_history.data();
+	for (int i = 0; i < count; ++i)
+	{
+		m_sum += samples[i];
+		if (++m_summed < m_decimation)
+			continue;
+
+		history[m_historyPos] = m_sum / m_decimation;
+		m_historyPos = (m_historyPos + 1) & (m_fftSize - 1);
+		m_sum = 0;
+		m_summed = 0;
+
+		if (++m_sinceFrame < m_hop)
+			continue;
+		m_sinceFrame = 0;
+
+		transform();
+		out.push(m_column.constData(), m_column.size());
+		++columns;
+	}
+	return columns;
+}
+
+void Spectrogram::transform()
+{
+	const int n = m_fftSize;
+	const double *history = m_history.constData();
+	const double *window = m_window.constData();
+	double *frame = m_frame.data();
+
+	// window the frame, oldest sample first
+	for (int i = 0; i < n; ++i)
+		frame[i] = history[(m_historyPos + i) & (n - 1)] * window[i];
+
+	m_fft.forwardReal(frame, m_re.data(), m_im.data());
+
+	// one-sided power in dB; the floor keeps silent bins finite
+	const double *re = m_re.constData();
+	const double *im = m_im.constData();
+	double *column = m_column.data();
+	for (int k = 0; k <= n / 2; ++k)
+	{
+		const double power = (re[k] * re[k] + im[k] * im[k]) * m_powerScale;
+		column[k] = 10 * std::log10(power + 1e-20);
+	}
+}
+
+template int Spectrogram::process(const float *, int, SampleRing<float> &);
+template int Spectrogram::process(const double *, int, SampleRing<double> &);
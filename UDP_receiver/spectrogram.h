@@ -0,0 +1,71 @@
+#ifndef SPECTROGRAM_H
+#define SPECTROGRAM_H
+
+#include <QVector>
+#include "samplering.h"
+#include "fft.h"
+
+/*
+ * Short-time power spectrum of a sample stream, computed incrementally.
+ *
+ * The Doppler baseband is a few hundred Hz wide at most, far below the
+ * scope's sample rate, so the input is first averaged down by decimation.
+ * Every hop decimated samples the latest fftSize of them are Hann windowed
+ * and transformed, which gives one column of binCount() = fftSize / 2 + 1
+ * power values in dB, from DC up to half the decimated sample rate.
+ * Consecutive frames overlap by fftSize - hop samples.
+ *
+ * process() may be called with any number of samples; the decimator, the
+ * frame history and the hop position carry over between calls, so a
+ * column costs the same whether its samples arrived in one call or many.
+ */
+class Spectrogram
+{
+public:
+	// fftSize must be a power of two, hop at most fftSize.
+	Spectrogram(int fftSize, int hop, int decimation);
+
+	int fftSize() const { return m_fftSize; }
+	int hop() const { return m_hop; }
+	int decimation() const { return m_decimation; }
+	// Changes the averaging factor; the decimated samples already in the
+	// history are kept, the partial average is dropped.
+	void setDecimation(int decimation);
+	int binCount() const { return m_fftSize / 2 + 1; }
+
+	// Frequency of bin for an input stream sampled at sampleRate.
+	double binFrequency(int bin, double sampleRate) const;
+
+	// Consumes count input samples and appends every finished column, binCount()
+	// values each, to out. Returns the number of columns appended. Sample is
+	// float or double; the transform runs in double.
+	template <typename Sample>
+	int process(const Sample *samples, int count, SampleRing<Sample> &out);
+
+private:
+	void transform();
+
+	const int m_fftSize;
+	const int m_hop;
+	int m_decimation;
+
+	// decimator state
+	double m_sum;
+	int m_summed;
+
+	// the last fftSize decimated samples, oldest first at m_historyPos
+	QVector<double> m_history;
+	int m_historyPos;
+	int m_sinceFrame;
+
+	QVector<double> m_window;
+	double m_powerScale;
+
+	Fft m_fft;
+	QVector<double> m_frame;
+	QVector<double> m_re;
+	QVector<double> m_im;
+	QVector<double> m_column;
+};
+
+#endif
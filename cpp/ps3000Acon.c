@@ -42,6 +42,7 @@
  *
  **************************************************************************/
 
+#define _GNU_SOURCE		/* sendmmsg() */
 #include <stdio.h>
 
 /* Headers for Windows */
@@ -61,6 +62,11 @@
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <sys/uio.h>
+#include <netinet/udp.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <libps3000a-1.1/ps3000aApi.h>
 #ifndef PICO_STATUS
@@ -133,6 +139,21 @@ int32_t cycles = 0;
 
 #define BUFFER_SIZE 	1024
 
+#include "streamformat.h"
+
+#define SEND_BATCH			64		/* messages per sendmmsg() call */
+#define GSO_MAX_SEGMENTS	64		/* datagrams per UDP GSO message (kernel limit) */
+#define MAX_DATAGRAM_SIZE	65507	/* largest IPv4 UDP payload */
+
+#define PIPELINE_BLOCKS		32		/* blocks in flight between the driver poll and the sender */
+#define BLOCK_SAMPLES		16384	/* samples per channel in one block */
+#define OVERRUN_WAIT_US		1000	/* how long the poller waits for a free block before dropping */
+#define DRIVER_BUFFER_SEGMENTS	4	/* zero-copy: driver buffer length in units of the largest callback */
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT			103		/* from linux/udp.h, for older C libraries */
+#endif
+
 #define QUAD_SCOPE		4
 #define DUAL_SCOPE		2
 
@@ -204,6 +225,15 @@ uint32_t	timebase = 8;
 int16_t     oversample = 1;
 BOOL		scaleVoltages = TRUE;
 
+/* Datagram size in bytes, headers included. Keep it at or below the path
+ * MTU less 28 bytes of IP/UDP header (1472 on plain Ethernet, 8972 with
+ * jumbo frames) unless the receiver is on this machine. This and the two
+ * below can be set on the command line, see parseOptions(). */
+uint32_t	datagramSize = 8192;
+BOOL		batchSend = TRUE;		// one sendmmsg() per batch instead of one sendmsg() per datagram
+BOOL		udpGso = TRUE;			// let the kernel split batches into datagrams (UDP GSO) where supported
+BOOL		zeroCopy = TRUE;		// send straight from the driver buffers instead of copying into blocks
+
 uint16_t inputRanges [PS3000A_MAX_RANGES] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000};
 
 BOOL     	g_ready = FALSE;
@@ -219,6 +249,8 @@ char BlockFile[20]		= "block.txt";
 char DigiBlockFile[20]	= "digiBlock.txt";
 char StreamFile[20]		= "stream.txt";
 
+typedef struct tStreamPipeline STREAM_PIPELINE;
+
 typedef struct tBufferInfo
 {
 	UNIT * unit;
@@ -227,9 +259,98 @@ typedef struct tBufferInfo
 	int16_t **appBuffers;
 	int16_t **driverDigBuffers;
 	int16_t **appDigBuffers;
+	STREAM_PIPELINE * pipeline;		// if set, analogue data goes here instead of appBuffers
 
 } BUFFER_INFO;
 
+typedef struct tStreamHeader
+{
+	DOPPLER_PACKET_HEADER packet;
+	DOPPLER_CHANNEL_HEADER channels[DOPPLER_MAX_CHANNELS];
+} STREAM_HEADER;
+
+typedef struct tStreamSender
+{
+	int						socket;
+	struct sockaddr_in		dest;
+	STREAM_HEADER			header;				// template for every datagram, see initStreamHeader
+	uint32_t				frameSize;			// bytes per sample on all channels
+	uint32_t				samplesPerDatagram;
+	uint32_t				batch;				// messages per send call, 1 = sendmsg()
+	uint32_t				gsoSegments;		// datagrams per message, 1 = no GSO
+	uint32_t				sequence;
+	uint64_t				streamedSamples;
+	uint64_t				datagrams;
+	uint64_t				syscalls;
+	STREAM_HEADER			headers[SEND_BATCH * GSO_MAX_SEGMENTS];
+	struct iovec			iovs[SEND_BATCH * GSO_MAX_SEGMENTS * (1 + DOPPLER_MAX_CHANNELS)];
+	struct mmsghdr			msgs[SEND_BATCH];
+	char					control[SEND_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+} STREAM_SENDER;
+
+typedef struct tSampleBlock
+{
+	uint64_t				firstSample;		// index since streaming started, counting dropped samples
+	uint32_t				noOfSamples;
+	int16_t *				samples[DOPPLER_MAX_CHANNELS];	// owned, or a region of the driver buffers (zero-copy)
+} SAMPLE_BLOCK;
+
+// FIFO of block numbers, guarded by the pipeline lock
+typedef struct tBlockQueue
+{
+	int32_t					items[PIPELINE_BLOCKS];
+	int32_t					head;
+	int32_t					count;
+} BLOCK_QUEUE;
+
+/*
+ * The driver is polled on the main thread, which copies each callback's
+ * samples into free blocks and queues them. The sender thread converts and
+ * transmits queued blocks and hands them back. The poller never waits on
+ * the network: if no block comes back within OVERRUN_WAIT_US the samples
+ * are dropped and counted as an overrun.
+ *
+ * In zero-copy mode a block is only a descriptor of the region of the
+ * driver buffers a callback reported, and the sender reads the samples in
+ * place. The driver writes that buffer during ps3000aGetStreamingLatestValues()
+ * only, sequentially and at most maxCallback samples per call, so before
+ * each poll pipelineReserve() makes sure the next write cannot reach the
+ * oldest sample still owned by the pipeline (queued or being sent). If the
+ * sender falls behind, the oldest queued regions are dropped as overruns
+ * instead; the region being sent is always waited for.
+ */
+struct tStreamPipeline
+{
+	pthread_t				thread;
+	pthread_mutex_t			lock;
+	pthread_cond_t			filled;				// a block was queued for sending
+	pthread_cond_t			freed;				// the sender returned a block
+	BLOCK_QUEUE				freeBlocks;
+	BLOCK_QUEUE				fullBlocks;
+	SAMPLE_BLOCK			blocks[PIPELINE_BLOCKS];
+	BOOL					stop;
+
+	UNIT *					unit;
+	STREAM_SENDER *			sender;
+	int32_t					channels;
+	const int16_t *			channelList;
+	int32_t *				voltageBuffer;		// sender thread only
+	SAMPLE_BLOCK *			inFlight;			// block being sent, if any
+
+	BOOL					zeroCopy;
+	uint32_t				driverBufferLength;	// zero-copy: samples per driver buffer
+	uint32_t				maxCallback;		// zero-copy: most samples one poll can deliver
+
+	uint64_t				nextSample;			// poller only
+	uint64_t				backPressure;		// times the poller had to wait for a free block
+	uint64_t				overruns;			// samples dropped for lack of a free block
+	uint64_t				sendErrors;
+	int32_t					maxQueued;
+};
+
+void pipelineWrite(STREAM_PIPELINE * pipeline, int16_t ** driverBuffers, uint32_t startIndex, int32_t noOfSamples);
+void pipelineReserve(STREAM_PIPELINE * pipeline);
+
 
 /****************************************************************************
 * Streaming callback
@@ -267,7 +388,11 @@ void PREF4 callBackStreaming(	int16_t handle,
 
 	if (bufferInfo != NULL && noOfSamples)
 	{
-		if (bufferInfo->mode == ANALOGUE)
+		if (bufferInfo->mode == ANALOGUE && bufferInfo->pipeline)
+		{
+			pipelineWrite(bufferInfo->pipeline, bufferInfo->driverBuffers, startIndex, noOfSamples);
+		}
+		else if (bufferInfo->mode == ANALOGUE)
 		{
 			for (channel = 0; channel < bufferInfo->unit->channelCount; channel++)
 			{
@@ -455,6 +580,685 @@ int16_t mv_to_adc(int16_t mv, int16_t ch, UNIT * unit)
 	return (mv * unit->maxValue) / inputRanges[ch];
 }
 
+/****************************************************************************
+* sampleRateHz
+*
+* Convert a streaming sample interval into samples per second
+****************************************************************************/
+uint32_t sampleRateHz(uint32_t sampleInterval, PS3000A_TIME_UNITS timeUnits)
+{
+	static const double unitSeconds[] = {1e-15, 1e-12, 1e-9, 1e-6, 1e-3, 1};
+
+	return (uint32_t) (1.0 / (sampleInterval * unitSeconds[timeUnits]) + 0.5);
+}
+
+/****************************************************************************
+* initStreamHeader
+*
+* Fill in the packet and channel headers sent in front of every datagram.
+* The per-packet fields (sequence, firstSample, sampleCount) are set by the
+* sender.
+****************************************************************************/
+void initStreamHeader(STREAM_HEADER * header, UNIT * unit, const int16_t * channelList,
+	int32_t channels, uint8_t sampleFormat, uint32_t sampleRate)
+{
+	int32_t i;
+
+	memset(header, 0, sizeof(STREAM_HEADER));
+	header->packet.magic = DOPPLER_STREAM_MAGIC;
+	header->packet.version = DOPPLER_STREAM_VERSION;
+	header->packet.headerSize = dopplerHeaderSize(channels);
+	header->packet.channelCount = channels;
+	header->packet.sampleFormat = sampleFormat;
+	header->packet.sampleRate = sampleRate;
+
+	for (i = 0; i < channels; i++)
+	{
+		CHANNEL_SETTINGS * settings = &unit->channelSettings[channelList[i]];
+
+		header->channels[i].channel = channelList[i];
+		header->channels[i].DCcoupled = settings->DCcoupled;
+		header->channels[i].rangeMv = inputRanges[settings->range];
+		header->channels[i].maxValue = unit->maxValue;
+	}
+}
+
+/****************************************************************************
+* openStreamSender
+*
+* Create the UDP socket the sample stream is sent from.
+* Returns NULL on failure.
+****************************************************************************/
+STREAM_SENDER * openStreamSender(const char * ip, uint16_t port)
+{
+	int sndbuf = 4 * 1024 * 1024;
+	STREAM_SENDER * sender = (STREAM_SENDER *) calloc(1, sizeof(STREAM_SENDER));
+
+	if (sender == NULL)
+	{
+		return NULL;
+	}
+
+	if ((sender->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+	{
+		free(sender);
+		return NULL;
+	}
+
+	setsockopt(sender->socket, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	sender->dest.sin_family = AF_INET;
+	sender->dest.sin_port = htons(port);
+
+	if (inet_aton(ip, &sender->dest.sin_addr) == 0)
+	{
+		fprintf(stderr, "inet_aton() failed\n");
+		close(sender->socket);
+		free(sender);
+		return NULL;
+	}
+
+	return sender;
+}
+
+void closeStreamSender(STREAM_SENDER * sender)
+{
+	close(sender->socket);
+	free(sender);
+}
+
+/****************************************************************************
+* configureStreamSender
+*
+* Set the stream header and how datagrams are batched.
+* - bytes - datagram size including headers, capped at MAX_DATAGRAM_SIZE
+* - batched - send SEND_BATCH messages per sendmmsg() call
+* - gso - pack several equally sized datagrams into one message and let
+*		the kernel split them (UDP_SEGMENT), if the kernel supports it
+****************************************************************************/
+void configureStreamSender(STREAM_SENDER * sender, const STREAM_HEADER * header, uint32_t bytes, BOOL batched, BOOL gso)
+{
+	uint32_t datagramBytes;
+	int off = 0;
+
+	sender->header = *header;
+	sender->frameSize = header->packet.channelCount * dopplerSampleSize(header->packet.sampleFormat);
+
+	bytes = min(bytes, MAX_DATAGRAM_SIZE);
+	sender->samplesPerDatagram = bytes > header->packet.headerSize + sender->frameSize ?
+		(bytes - header->packet.headerSize) / sender->frameSize : 1;
+	datagramBytes = header->packet.headerSize + sender->samplesPerDatagram * sender->frameSize;
+
+	sender->batch = batched ? SEND_BATCH : 1;
+	sender->gsoSegments = 1;
+
+	// setting a zero segment size only probes for kernel support
+	if (gso && setsockopt(sender->socket, SOL_UDP, UDP_SEGMENT, &off, sizeof(off)) == 0)
+	{
+		sender->gsoSegments = min(GSO_MAX_SEGMENTS, MAX_DATAGRAM_SIZE / datagramBytes);
+	}
+
+	if (sender->gsoSegments < 2)
+	{
+		sender->gsoSegments = 1;
+	}
+}
+
+/****************************************************************************
+* streamSend
+*
+* Send noOfSamples samples, starting at sample offset, as a run of
+* datagrams. sources holds one interleaved buffer of sample frames, or one
+* buffer per channel if the header has DOPPLER_FLAG_PLANAR set. The samples
+* are gathered straight from the sources, nothing is copied.
+*
+* Returns 0, or -1 if the socket reported an error.
+****************************************************************************/
+int32_t streamSend(STREAM_SENDER * sender, const void * const * sources, uint32_t offset, uint32_t noOfSamples)
+{
+	const uint32_t headerSize = sender->header.packet.headerSize;
+	const BOOL planar = (sender->header.packet.flags & DOPPLER_FLAG_PLANAR) != 0;
+	const int32_t sourceCount = planar ? sender->header.packet.channelCount : 1;
+	const uint32_t sourceStride = planar ? dopplerSampleSize(sender->header.packet.sampleFormat) : sender->frameSize;
+	const uint32_t segmentBytes = headerSize + sender->samplesPerDatagram * sender->frameSize;
+
+	uint32_t msgDone[SEND_BATCH];
+	uint32_t msgSequence[SEND_BATCH];
+	uint32_t msgDatagrams[SEND_BATCH];
+	uint32_t done = 0;
+
+	while (done < noOfSamples)
+	{
+		uint32_t nMsgs = 0;
+		uint32_t nDatagrams = 0;
+		uint32_t nIovs = 0;
+		uint32_t sent = 0;
+		int32_t i;
+
+		// build up to one batch of messages, each holding up to gsoSegments datagrams
+		while (nMsgs < sender->batch && done < noOfSamples)
+		{
+			struct msghdr * hdr = &sender->msgs[nMsgs].msg_hdr;
+			uint32_t segments = 0;
+			uint32_t firstIov = nIovs;
+
+			msgDone[nMsgs] = done;
+			msgSequence[nMsgs] = sender->sequence;
+
+			memset(hdr, 0, sizeof(struct msghdr));
+			hdr->msg_name = &sender->dest;
+			hdr->msg_namelen = sizeof(sender->dest);
+			hdr->msg_iov = &sender->iovs[firstIov];
+
+			while (segments < sender->gsoSegments && done < noOfSamples)
+			{
+				uint32_t n = min(sender->samplesPerDatagram, noOfSamples - done);
+				STREAM_HEADER * header = &sender->headers[nDatagrams++];
+				int32_t c;
+
+				memcpy(header, &sender->header, headerSize);
+				header->packet.sequence = sender->sequence++;
+				header->packet.firstSample = sender->streamedSamples + done;
+				header->packet.sampleCount = n;
+
+				sender->iovs[nIovs].iov_base = header;
+				sender->iovs[nIovs++].iov_len = headerSize;
+
+				for (c = 0; c < sourceCount; c++)
+				{
+					sender->iovs[nIovs].iov_base = (char *) sources[c] + (size_t) (offset + done) * sourceStride;
+					sender->iovs[nIovs++].iov_len = n * sourceStride;
+				}
+
+				done += n;
+				segments++;
+
+				if (n < sender->samplesPerDatagram)
+				{
+					break;		// only the last segment of a GSO message may be short
+				}
+			}
+
+			hdr->msg_iovlen = nIovs - firstIov;
+			msgDatagrams[nMsgs] = segments;
+
+			if (segments > 1)
+			{
+				struct cmsghdr * cmsg;
+				uint16_t gsoSize = segmentBytes;
+
+				hdr->msg_control = sender->control[nMsgs];
+				hdr->msg_controllen = sizeof(sender->control[nMsgs]);
+				cmsg = CMSG_FIRSTHDR(hdr);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				memcpy(CMSG_DATA(cmsg), &gsoSize, sizeof(gsoSize));
+			}
+
+			nMsgs++;
+		}
+
+		while (sent < nMsgs)
+		{
+			int r;
+
+			if (sender->batch == 1)
+			{
+				r = sendmsg(sender->socket, &sender->msgs[sent].msg_hdr, 0) == -1 ? -1 : 1;
+			}
+			else
+			{
+				r = sendmmsg(sender->socket, &sender->msgs[sent], nMsgs - sent, 0);
+			}
+
+			sender->syscalls++;
+
+			if (r == -1)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				if ((errno == EIO || errno == EINVAL) && sender->gsoSegments > 1)
+				{
+					// the route has no checksum offload (EIO), or the kernel or NIC
+					// refuses the segment size (EINVAL); rebuild the unsent part without GSO
+					printf("UDP GSO not usable on this route, sending plain datagrams\n");
+					sender->gsoSegments = 1;
+					done = msgDone[sent];
+					sender->sequence = msgSequence[sent];
+					break;
+				}
+
+				return -1;
+			}
+
+			// only count what the kernel took, a batch resent without GSO counts once
+			for (i = 0; i < r; i++)
+			{
+				sender->datagrams += msgDatagrams[sent++];
+			}
+		}
+	}
+
+	sender->streamedSamples += noOfSamples;
+	return 0;
+}
+
+void queuePush(BLOCK_QUEUE * queue, int32_t block)
+{
+	queue->items[(queue->head + queue->count++) % PIPELINE_BLOCKS] = block;
+}
+
+int32_t queuePop(BLOCK_QUEUE * queue)
+{
+	int32_t block = queue->items[queue->head];
+
+	queue->head = (queue->head + 1) % PIPELINE_BLOCKS;
+	queue->count--;
+	return block;
+}
+
+/****************************************************************************
+* pipelineSender
+*
+* Sender thread: converts queued blocks to the wire format and sends them
+****************************************************************************/
+void * pipelineSender(void * parameter)
+{
+	STREAM_PIPELINE * pipeline = (STREAM_PIPELINE *) parameter;
+	const void * sources[DOPPLER_MAX_CHANNELS];
+	SAMPLE_BLOCK * block;
+	uint32_t i, done, n;
+	uint32_t errors;	// counted into sendErrors under the lock
+	int32_t c;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pipeline->lock);
+
+		while (pipeline->fullBlocks.count == 0 && !pipeline->stop)
+		{
+			pthread_cond_wait(&pipeline->filled, &pipeline->lock);
+		}
+
+		if (pipeline->fullBlocks.count == 0)
+		{
+			pthread_mutex_unlock(&pipeline->lock);
+			break;
+		}
+
+		block = &pipeline->blocks[queuePop(&pipeline->fullBlocks)];
+		pipeline->inFlight = block;
+		pthread_mutex_unlock(&pipeline->lock);
+
+		pipeline->sender->streamedSamples = block->firstSample;
+		errors = 0;
+
+		if (scaleVoltages)
+		{
+			// zero-copy regions can be longer than the scratch buffer
+			for (done = 0; done < block->noOfSamples; done += n)
+			{
+				n = min(BLOCK_SAMPLES, block->noOfSamples - done);
+
+				for (i = 0; i < n; i++)
+				{
+					for (c = 0; c < pipeline->channels; c++)
+					{
+						pipeline->voltageBuffer[i * pipeline->channels + c] = adc_to_mv(block->samples[c][done + i],
+							pipeline->unit->channelSettings[pipeline->channelList[c]].range, pipeline->unit);
+					}
+				}
+				sources[0] = pipeline->voltageBuffer;
+
+				if (streamSend(pipeline->sender, sources, 0, n) != 0)
+				{
+					errors++;
+				}
+			}
+		}
+		else
+		{
+			for (c = 0; c < pipeline->channels; c++)
+			{
+				sources[c] = block->samples[c];
+			}
+
+			if (streamSend(pipeline->sender, sources, 0, block->noOfSamples) != 0)
+			{
+				errors++;
+			}
+		}
+
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->sendErrors += errors;
+		pipeline->inFlight = NULL;
+		queuePush(&pipeline->freeBlocks, block - pipeline->blocks);
+		pthread_cond_signal(&pipeline->freed);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+
+	return NULL;
+}
+
+/****************************************************************************
+* oldestOwnedSample
+*
+* Zero-copy: first sample the pipeline may still read from the driver
+* buffers. Call with the pipeline lock held.
+****************************************************************************/
+uint64_t oldestOwnedSample(STREAM_PIPELINE * pipeline, BOOL includeInFlight)
+{
+	if (includeInFlight && pipeline->inFlight)
+	{
+		return pipeline->inFlight->firstSample;
+	}
+
+	if (pipeline->fullBlocks.count)
+	{
+		return pipeline->blocks[pipeline->fullBlocks.items[pipeline->fullBlocks.head]].firstSample;
+	}
+
+	return pipeline->nextSample;
+}
+
+/****************************************************************************
+* pipelineReserve
+*
+* Zero-copy: called before every ps3000aGetStreamingLatestValues(). Waits
+* until the driver can write maxCallback more samples without touching a
+* region the sender has not finished with. After OVERRUN_WAIT_US the oldest
+* queued regions are dropped; the region being sent is always waited for.
+****************************************************************************/
+void pipelineReserve(STREAM_PIPELINE * pipeline)
+{
+	struct timespec deadline;
+	BOOL timedOut = FALSE;
+
+	if (!pipeline->zeroCopy)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&pipeline->lock);
+
+	if (pipeline->nextSample + pipeline->maxCallback - oldestOwnedSample(pipeline, TRUE) > pipeline->driverBufferLength)
+	{
+		pipeline->backPressure++;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += OVERRUN_WAIT_US * 1000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	while (pipeline->nextSample + pipeline->maxCallback - oldestOwnedSample(pipeline, TRUE) > pipeline->driverBufferLength)
+	{
+		if (timedOut && pipeline->fullBlocks.count &&
+			pipeline->nextSample + pipeline->maxCallback - oldestOwnedSample(pipeline, FALSE) > pipeline->driverBufferLength)
+		{
+			// the sender is too far behind; give up the oldest queued region
+			SAMPLE_BLOCK * block = &pipeline->blocks[queuePop(&pipeline->fullBlocks)];
+
+			pipeline->overruns += block->noOfSamples;
+			queuePush(&pipeline->freeBlocks, block - pipeline->blocks);
+		}
+		else if (timedOut)
+		{
+			pthread_cond_wait(&pipeline->freed, &pipeline->lock);
+		}
+		else if (pthread_cond_timedwait(&pipeline->freed, &pipeline->lock, &deadline) == ETIMEDOUT)
+		{
+			timedOut = TRUE;
+		}
+	}
+
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+/****************************************************************************
+* pipelinePublish
+*
+* Zero-copy: queue the region of the driver buffers a callback reported.
+* pipelineReserve() has already made room, so a free block always exists.
+****************************************************************************/
+void pipelinePublish(STREAM_PIPELINE * pipeline, int16_t ** driverBuffers, uint32_t startIndex, int32_t noOfSamples)
+{
+	SAMPLE_BLOCK * block;
+	int32_t c;
+
+	pthread_mutex_lock(&pipeline->lock);
+
+	if (pipeline->freeBlocks.count == 0)
+	{
+		// only possible if more than PIPELINE_BLOCKS tiny regions are queued
+		pipeline->overruns += noOfSamples;
+		pipeline->nextSample += noOfSamples;
+		pthread_mutex_unlock(&pipeline->lock);
+		return;
+	}
+
+	block = &pipeline->blocks[queuePop(&pipeline->freeBlocks)];
+
+	for (c = 0; c < pipeline->channels; c++)
+	{
+		block->samples[c] = &driverBuffers[pipeline->channelList[c] * 2][startIndex];
+	}
+	block->firstSample = pipeline->nextSample;
+	block->noOfSamples = noOfSamples;
+	pipeline->nextSample += noOfSamples;
+
+	queuePush(&pipeline->fullBlocks, block - pipeline->blocks);
+	pipeline->maxQueued = max(pipeline->maxQueued, pipeline->fullBlocks.count);
+	pthread_cond_signal(&pipeline->filled);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+/****************************************************************************
+* pipelineWrite
+*
+* Poller side, called from the streaming callback: copy noOfSamples new
+* samples of the driver buffers into free blocks and queue them for sending
+****************************************************************************/
+void pipelineWrite(STREAM_PIPELINE * pipeline, int16_t ** driverBuffers, uint32_t startIndex, int32_t noOfSamples)
+{
+	int32_t done = 0;
+
+	if (pipeline->zeroCopy)
+	{
+		pipelinePublish(pipeline, driverBuffers, startIndex, noOfSamples);
+		return;
+	}
+
+	while (done < noOfSamples)
+	{
+		int32_t n = min(BLOCK_SAMPLES, noOfSamples - done);
+		SAMPLE_BLOCK * block;
+		int32_t c;
+
+		pthread_mutex_lock(&pipeline->lock);
+
+		if (pipeline->freeBlocks.count == 0)
+		{
+			struct timespec deadline;
+
+			pipeline->backPressure++;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += OVERRUN_WAIT_US * 1000;
+			if (deadline.tv_nsec >= 1000000000)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+
+			while (pipeline->freeBlocks.count == 0)
+			{
+				if (pthread_cond_timedwait(&pipeline->freed, &pipeline->lock, &deadline) == ETIMEDOUT)
+				{
+					break;
+				}
+			}
+
+			if (pipeline->freeBlocks.count == 0)
+			{
+				// the sender is too far behind; drop the rest of this callback
+				pipeline->overruns += noOfSamples - done;
+				pipeline->nextSample += noOfSamples - done;
+				pthread_mutex_unlock(&pipeline->lock);
+				return;
+			}
+		}
+
+		block = &pipeline->blocks[queuePop(&pipeline->freeBlocks)];
+		pthread_mutex_unlock(&pipeline->lock);
+
+		for (c = 0; c < pipeline->channels; c++)
+		{
+			memcpy(block->samples[c], &driverBuffers[pipeline->channelList[c] * 2][startIndex + done], n * sizeof(int16_t));
+		}
+		block->firstSample = pipeline->nextSample;
+		block->noOfSamples = n;
+		pipeline->nextSample += n;
+		done += n;
+
+		pthread_mutex_lock(&pipeline->lock);
+		queuePush(&pipeline->fullBlocks, block - pipeline->blocks);
+		pipeline->maxQueued = max(pipeline->maxQueued, pipeline->fullBlocks.count);
+		pthread_cond_signal(&pipeline->filled);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+}
+
+/****************************************************************************
+* freePipeline
+*
+* Free the block pool and the pipeline itself; the sender thread must not
+* be running. Blocks that were never allocated are NULL.
+****************************************************************************/
+void freePipeline(STREAM_PIPELINE * pipeline)
+{
+	int32_t i, c;
+
+	for (i = 0; i < PIPELINE_BLOCKS; i++)
+	{
+		for (c = 0; c < pipeline->channels && !pipeline->zeroCopy; c++)
+		{
+			free(pipeline->blocks[i].samples[c]);
+		}
+	}
+
+	free(pipeline->voltageBuffer);
+	free(pipeline);
+}
+
+/****************************************************************************
+* openPipeline
+*
+* Allocate the block pool and start the sender thread. A non-zero
+* driverBufferLength selects zero-copy mode, where maxCallback is the
+* largest number of samples a single poll can deliver.
+* Returns NULL on failure.
+****************************************************************************/
+STREAM_PIPELINE * openPipeline(UNIT * unit, STREAM_SENDER * sender, const int16_t * channelList, int32_t channels,
+	uint32_t driverBufferLength, uint32_t maxCallback)
+{
+	STREAM_PIPELINE * pipeline = (STREAM_PIPELINE *) calloc(1, sizeof(STREAM_PIPELINE));
+	int32_t i, c;
+
+	if (pipeline == NULL)
+	{
+		return NULL;
+	}
+
+	pipeline->unit = unit;
+	pipeline->sender = sender;
+	pipeline->channels = channels;
+	pipeline->channelList = channelList;
+	pipeline->zeroCopy = driverBufferLength > 0;
+	pipeline->driverBufferLength = driverBufferLength;
+	pipeline->maxCallback = maxCallback;
+	pipeline->voltageBuffer = (int32_t *) calloc(BLOCK_SAMPLES * channels, sizeof(int32_t));
+
+	if (pipeline->voltageBuffer == NULL)
+	{
+		printf("Unable to allocate the pipeline blocks\n");
+		freePipeline(pipeline);
+		return NULL;
+	}
+
+	for (i = 0; i < PIPELINE_BLOCKS; i++)
+	{
+		for (c = 0; c < channels && !pipeline->zeroCopy; c++)
+		{
+			if ((pipeline->blocks[i].samples[c] = (int16_t *) calloc(BLOCK_SAMPLES, sizeof(int16_t))) == NULL)
+			{
+				printf("Unable to allocate the pipeline blocks\n");
+				freePipeline(pipeline);
+				return NULL;
+			}
+		}
+		queuePush(&pipeline->freeBlocks, i);
+	}
+
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->filled, NULL);
+	pthread_cond_init(&pipeline->freed, NULL);
+
+	// the sender thread is the only one; if it did not start there is
+	// nothing to join, just undo the setup
+	if (pthread_create(&pipeline->thread, NULL, pipelineSender, pipeline) != 0)
+	{
+		printf("Unable to start the sender thread\n");
+		pthread_mutex_destroy(&pipeline->lock);
+		pthread_cond_destroy(&pipeline->filled);
+		pthread_cond_destroy(&pipeline->freed);
+		freePipeline(pipeline);
+		return NULL;
+	}
+
+	return pipeline;
+}
+
+/****************************************************************************
+* closePipeline
+*
+* Send whatever is still queued, stop the sender thread and free the pool
+****************************************************************************/
+void closePipeline(STREAM_PIPELINE * pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->stop = TRUE;
+	pthread_cond_signal(&pipeline->filled);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	pthread_join(pipeline->thread, NULL);
+
+	pthread_mutex_destroy(&pipeline->lock);
+	pthread_cond_destroy(&pipeline->filled);
+	pthread_cond_destroy(&pipeline->freed);
+
+	freePipeline(pipeline);
+}
+
+/****************************************************************************
+* printPipelineStatus
+****************************************************************************/
+void printPipelineStatus(STREAM_PIPELINE * pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	printf("Pipeline%s: %d of %d blocks queued (max %d), back-pressure %llu, overruns %llu samples, send errors %llu\n",
+		pipeline->zeroCopy ? " (zero-copy)" : "", pipeline->fullBlocks.count, PIPELINE_BLOCKS, pipeline->maxQueued,
+		(unsigned long long) pipeline->backPressure, (unsigned long long) pipeline->overruns,
+		(unsigned long long) pipeline->sendErrors);
+	pipeline->maxQueued = 0;
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
 /****************************************************************************************
 * changePowerSource - function to handle switches between +5V supply, and USB only power
 * Only applies to ps34xxA/B units 
@@ -888,7 +1692,7 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 	int16_t * appDigiBuffers[PS3000A_MAX_DIGITAL_PORTS];
 	
 	int channels = 2;
-	int *voltageBuffers = (int*) calloc(sampleCount * channels, sizeof(int));
+	const int16_t channelList[2] = {PS3000A_CHANNEL_A, PS3000A_CHANNEL_B};
 	//int *A_buf = (int*) calloc(sampleCount, sizeof(int));
 	//int *B_buf = (int*) calloc(sampleCount, sizeof(int));
 	//int *C_buf = (int*) calloc(sampleCount, sizeof(int));
@@ -904,22 +1708,17 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 
 	// UDP socket setup
 	
-	struct sockaddr_in si_other;
-	int s, slen=sizeof(si_other);
-	//char buf[4];
-	char buf[50];
+	STREAM_HEADER streamHeader;
+	STREAM_SENDER * sender;
+	STREAM_PIPELINE * pipeline = NULL;
+	time_t lastStatus = 0;
+	// zero-copy: the driver buffers are longer than the largest callback
+	// (sampleCount), so the sender can read a region while the driver writes the next
+	uint32_t driverBufferLength = zeroCopy && mode == ANALOGUE ? DRIVER_BUFFER_SEGMENTS * sampleCount : sampleCount;
 	
-	if ( (s=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+	if ((sender = openStreamSender(SRV_IP, PORT)) == NULL)
 		exit(1);
 
-	memset((char *) &si_other, 0, sizeof(si_other));
-	si_other.sin_family = AF_INET;
-	si_other.sin_port = htons(PORT);
-	if (inet_aton(SRV_IP, &si_other.sin_addr)==0) {
-	  fprintf(stderr, "inet_aton() failed\n");
-	  exit(1);
-	}
-
 
 
 	if (mode == ANALOGUE)		// Analogue - collect raw data
@@ -928,13 +1727,10 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 		{
 			if(unit->channelSettings[i].enabled)
 			{
-				buffers[i * 2] = (int16_t*) calloc(sampleCount, sizeof(int16_t));
-				buffers[i * 2 + 1] = (int16_t*) calloc(sampleCount, sizeof(int16_t));
+				buffers[i * 2] = (int16_t*) calloc(driverBufferLength, sizeof(int16_t));
+				buffers[i * 2 + 1] = (int16_t*) calloc(driverBufferLength, sizeof(int16_t));
 
-				status = ps3000aSetDataBuffers(unit->handle, (PS3000A_CHANNEL)i, buffers[i * 2], buffers[i * 2 + 1], sampleCount, 0, PS3000A_RATIO_MODE_NONE);
-
-				appBuffers[i * 2] = (int16_t*) calloc(sampleCount, sizeof(int16_t));
-				appBuffers[i * 2 + 1] = (int16_t*) calloc(sampleCount, sizeof(int16_t));
+				status = ps3000aSetDataBuffers(unit->handle, (PS3000A_CHANNEL)i, buffers[i * 2], buffers[i * 2 + 1], driverBufferLength, 0, PS3000A_RATIO_MODE_NONE);
 
 				printf(status ? "StreamDataHandler:ps3000aSetDataBuffers(channel %ld) ------ 0x%08lx \n":"", i, status);
 			}
@@ -963,6 +1759,7 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 	bufferInfo.appBuffers = appBuffers;
 	bufferInfo.driverDigBuffers = digiBuffers;
 	bufferInfo.appDigBuffers = appDigiBuffers;
+	bufferInfo.pipeline = NULL;		// started once the sample rate is known
 
 	if (autostop)
 	{
@@ -1009,6 +1806,34 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 
 	printf("Streaming data...Press a key to stop\n");
 
+	// sampleInterval now holds the interval the driver actually selected.
+	// Without scaleVoltages the raw ADC counts are sent straight from the
+	// pipeline blocks, one run per channel, and the receiver converts to mV.
+	initStreamHeader(&streamHeader, unit, channelList, channels,
+		scaleVoltages ? DOPPLER_FORMAT_S32_MV : DOPPLER_FORMAT_S16_ADC,
+		sampleRateHz(sampleInterval, timeUnits));
+
+	if (!scaleVoltages)
+	{
+		streamHeader.packet.flags = DOPPLER_FLAG_PLANAR;
+	}
+
+	configureStreamSender(sender, &streamHeader, datagramSize, batchSend, udpGso);
+
+	printf("Sending %u samples per datagram%s%s\n", sender->samplesPerDatagram,
+		sender->batch > 1 ? ", batched" : "", sender->gsoSegments > 1 ? ", UDP GSO" : "");
+
+	if (mode == ANALOGUE)
+	{
+		if ((pipeline = openPipeline(unit, sender, channelList, channels,
+			zeroCopy ? driverBufferLength : 0, sampleCount)) == NULL)
+		{
+			ps3000aStop(unit->handle);
+			exit(1);
+		}
+		bufferInfo.pipeline = pipeline;
+	}
+
 	//if (mode == ANALOGUE)
 	//{
 	//	fopen_s(&fp, StreamFile, "w");
@@ -1036,6 +1861,11 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 		// Register callback function with driver and check if data has been received
 		g_ready = FALSE;
 
+		if (pipeline)
+		{
+			pipelineReserve(pipeline);
+		}
+
 		status = ps3000aGetStreamingLatestValues(unit->handle, callBackStreaming, &bufferInfo);
 
 		if(status == PICO_POWER_SUPPLY_CONNECTED || status == PICO_POWER_SUPPLY_NOT_CONNECTED || status == PICO_POWER_SUPPLY_UNDERVOLTAGE) // 34xxA/B devices...+5V PSU connected or removed
@@ -1061,38 +1891,18 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 
 			printf("Collected %li samples, index = %lu, Total: %d samples \n", g_sampleCount, g_startIndex, totalSamples);
 
+			if (pipeline && time(NULL) != lastStatus)
+			{
+				printPipelineStatus(pipeline);
+				lastStatus = time(NULL);
+			}
+
 			if (g_trig)
 			{
 				printf("Trig. at index %lu", triggeredAt);	// show where trigger occurred
 			}
 			
-			for (i = g_startIndex; i < (int32_t)(g_startIndex + g_sampleCount); i++) {
-				voltageBuffers[i*channels] = adc_to_mv(appBuffers[0][i], unit->channelSettings[PS3000A_CHANNEL_A + 0].range, unit);
-				voltageBuffers[i*channels+1] = adc_to_mv(appBuffers[2][i], unit->channelSettings[PS3000A_CHANNEL_A + 1].range, unit);
-				//voltageBuffers[i*channels+2] = adc_to_mv(appBuffers[4][i], unit->channelSettings[PS3000A_CHANNEL_A + 2].range, unit);
-			}
-			//int packetsize = 1000, j = g_startIndex;	
-			int packetsize = 100, j = g_startIndex;	
-			for (; j <	(int32_t)(g_startIndex + g_sampleCount); j+=packetsize){
-				int diff = 100;
-				//printf("diff: %d\n", diff);
-				//printf("startindex: %d, j: %d, g_sampleCount: %d, end: %d\n", g_startIndex, j, g_sampleCount, (int32_t)(g_sampleCount + g_startIndex));
-				
-				if((g_startIndex+g_sampleCount) < j+packetsize){
-				   	diff = 100 - (j+packetsize - (g_startIndex+g_sampleCount));
-					//printf("diff: %d\n", diff);
-				}
-				int p;
-				for(p = 0; p < packetsize; p++){
-					//printf("%d\n", voltageBuffers[j*channels + p]);
-				}
-				if (sendto(s, &(voltageBuffers[j*channels]), diff*channels*sizeof(int), 0, &si_other, slen)==-1){
-					printf("Failed to send data, j = %d, g_startIndex = %d, diff = %d,  sampleCount = %d", j, g_startIndex, diff, g_sampleCount);
-					close(s);
-					exit(1);
-				}
-				
-			}
+			// the callback has already queued the new samples for the sender thread
 			/*
 			for (i = g_startIndex; i < (int32_t)(g_startIndex + g_sampleCount); i++) {
 
@@ -1169,9 +1979,6 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 			{
 				free(buffers[i * 2]);
 				free(buffers[i * 2 + 1]);
-
-				free(appBuffers[i * 2]);
-				free(appBuffers[i * 2 + 1]);
 			}
 		}
 	}
@@ -1195,7 +2002,13 @@ void streamDataHandler(UNIT * unit, uint32_t preTrigger, MODE mode)
 		}
 	}
 
-	close(s);
+	if (pipeline)
+	{
+		closePipeline(pipeline);
+	}
+
+	printf("Sent %llu datagrams in %llu system calls\n", (unsigned long long) sender->datagrams, (unsigned long long) sender->syscalls);
+	closeStreamSender(sender);
 	clearDataBuffers(unit);
 }
 
@@ -2035,14 +2848,200 @@ void calcDoppler(UNIT *unit)
 
 }
 
+/****************************************************************************
+* streamBenchmark
+*
+* Measures how many samples per second the UDP send path can push to the
+* receiver port, for several datagram sizes and send modes. No scope is
+* needed: the samples are synthetic.
+*
+* Run with:	ps3000acon --bench
+***************************************************************************/
+int32_t streamBenchmark(void)
+{
+	static const uint32_t sizes[] = {832, 1472, 8972, MAX_DATAGRAM_SIZE};
+	static const char * modeNames[] = {"sendmsg", "sendmmsg", "sendmmsg+GSO"};
+	const uint32_t chunk = 100000;		// samples per driver callback, as in streamDataHandler
+	const int16_t channelList[2] = {PS3000A_CHANNEL_A, PS3000A_CHANNEL_B};
+	const int32_t channels = 2;
+
+	int16_t * planes[2];
+	int32_t * frames;
+	const void * sources[2];
+	STREAM_HEADER header;
+	STREAM_SENDER * sender;
+	UNIT unit;
+	uint32_t i;
+	int32_t format, size, mode;
+
+	if ((sender = openStreamSender(SRV_IP, PORT)) == NULL)
+	{
+		printf("Unable to open socket\n");
+		return 1;
+	}
+
+	memset(&unit, 0, sizeof(UNIT));
+	unit.maxValue = 32512;
+	unit.channelSettings[PS3000A_CHANNEL_A].range = PS3000A_5V;
+	unit.channelSettings[PS3000A_CHANNEL_B].range = PS3000A_5V;
+
+	planes[0] = (int16_t *) calloc(chunk, sizeof(int16_t));
+	planes[1] = (int16_t *) calloc(chunk, sizeof(int16_t));
+	frames = (int32_t *) calloc(chunk * channels, sizeof(int32_t));
+
+	for (i = 0; i < chunk; i++)
+	{
+		planes[0][i] = (int16_t) (i * 37);
+		planes[1][i] = (int16_t) (i * 91);
+		frames[i * channels] = planes[0][i];
+		frames[i * channels + 1] = planes[1][i];
+	}
+
+	printf("Sending to %s:%d\n\n", SRV_IP, PORT);
+	printf("%-8s %9s %14s %16s %14s\n", "format", "datagram", "mode", "samples/s", "datagrams/call");
+
+	for (format = 0; format < 2; format++)
+	{
+		initStreamHeader(&header, &unit, channelList, channels,
+			format ? DOPPLER_FORMAT_S16_ADC : DOPPLER_FORMAT_S32_MV, 250000);
+
+		if (format)
+		{
+			header.packet.flags = DOPPLER_FLAG_PLANAR;
+			sources[0] = planes[0];
+			sources[1] = planes[1];
+		}
+		else
+		{
+			sources[0] = frames;
+		}
+
+		for (size = 0; size < (int32_t) (sizeof(sizes) / sizeof(sizes[0])); size++)
+		{
+			for (mode = 0; mode < 3; mode++)
+			{
+				struct timespec start, now;
+				double elapsed = 0;
+				uint64_t samples = 0;
+
+				configureStreamSender(sender, &header, sizes[size], mode > 0, mode > 1);
+
+				if (mode > 1 && sender->gsoSegments == 1)
+				{
+					continue;	// GSO unsupported, or a single datagram already fills a message
+				}
+
+				sender->sequence = 0;
+				sender->streamedSamples = 0;
+				sender->datagrams = 0;
+				sender->syscalls = 0;
+
+				clock_gettime(CLOCK_MONOTONIC, &start);
+
+				do
+				{
+					if (streamSend(sender, sources, 0, chunk) != 0)
+					{
+						printf("Send failed: %s\n", strerror(errno));
+						break;
+					}
+
+					samples += chunk;
+					clock_gettime(CLOCK_MONOTONIC, &now);
+					elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+				}
+				while (elapsed < 0.5);
+
+				if (samples > 0)
+				{
+					printf("%-8s %9u %14s %16.0f %14.1f\n", format ? "int16" : "int32 mV", sizes[size], modeNames[mode],
+						samples / elapsed, (double) sender->datagrams / sender->syscalls);
+				}
+			}
+		}
+	}
+
+	closeStreamSender(sender);
+	free(planes[0]);
+	free(planes[1]);
+	free(frames);
+
+	return 0;
+}
+
+/****************************************************************************
+* parseOptions
+*
+* Reads the command line into the send settings:
+*	--bench				measure the send path and exit
+*	--datagram-size N	datagram size in bytes, headers included
+*	--no-batch			one sendmsg() per datagram
+*	--no-gso			no UDP GSO even where the kernel supports it
+*
+* Returns 0, or -1 after printing the usage on an unknown option.
+***************************************************************************/
+int32_t parseOptions(int argc, char * argv[], BOOL * bench)
+{
+	int32_t i;
+	char * end;
+
+	*bench = FALSE;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--bench") == 0)
+		{
+			*bench = TRUE;
+		}
+		else if (strcmp(argv[i], "--datagram-size") == 0 && i + 1 < argc)
+		{
+			unsigned long bytes = strtoul(argv[++i], &end, 10);
+
+			if (*end != '\0' || bytes == 0 || bytes > MAX_DATAGRAM_SIZE)
+			{
+				printf("--datagram-size must be 1 to %d bytes\n", MAX_DATAGRAM_SIZE);
+				return -1;
+			}
+
+			datagramSize = (uint32_t) bytes;
+		}
+		else if (strcmp(argv[i], "--no-batch") == 0)
+		{
+			batchSend = FALSE;
+		}
+		else if (strcmp(argv[i], "--no-gso") == 0)
+		{
+			udpGso = FALSE;
+		}
+		else
+		{
+			printf("Usage: %s [--bench] [--datagram-size N] [--no-batch] [--no-gso]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
 /****************************************************************************
 * New main, to capture data and compute doppler
 ***************************************************************************/
-int32_t main(void)
+int32_t main(int argc, char * argv[])
 {
 	char ch;
 	PICO_STATUS status;
 	UNIT unit;
+	BOOL bench;
+
+	if (parseOptions(argc, argv, &bench) != 0)
+	{
+		return 1;
+	}
+
+	if (bench)
+	{
+		return streamBenchmark();
+	}
 
 	printf("PS3000A Doppler Computer\n");
 	printf("\nOpening the device...\n");
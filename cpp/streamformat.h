@@ -0,0 +1,79 @@
+/****************************************************************************
+ * streamformat.h
+ *
+ * Wire format of the sample stream sent by ps3000acon to the receiver
+ * (UDP_receiver). Both ends include this file.
+ *
+ * Every datagram is laid out as:
+ *
+ *    DOPPLER_PACKET_HEADER
+ *    DOPPLER_CHANNEL_HEADER   x channelCount
+ *    sample frames            x sampleCount
+ *
+ * where a sample frame holds one sample per channel, in channel header
+ * order. With DOPPLER_FLAG_PLANAR set the samples are instead grouped by
+ * channel: sampleCount samples of the first channel, then of the second,
+ * and so on. All fields are little-endian. The structures are naturally
+ * aligned, so no packing pragmas are needed.
+ *
+ * A receiver must reject a datagram whose magic or version it does not
+ * know, and must use headerSize (not sizeof) to find the first sample
+ * frame so that fields can be appended to the headers later.
+ ****************************************************************************/
+
+#ifndef STREAMFORMAT_H
+#define STREAMFORMAT_H
+
+#include <stdint.h>
+
+#define DOPPLER_STREAM_MAGIC	0x524C5044u		/* "DPLR" */
+#define DOPPLER_STREAM_VERSION	1
+#define DOPPLER_MAX_CHANNELS	4
+
+#define DOPPLER_FLAG_PLANAR		0x0001	/* samples grouped by channel */
+
+typedef enum enDopplerSampleFormat
+{
+	DOPPLER_FORMAT_S32_MV = 0,		/* int32_t millivolts */
+	DOPPLER_FORMAT_S16_ADC = 1		/* int16_t raw ADC counts, mV = count * rangeMv / maxValue */
+} DOPPLER_SAMPLE_FORMAT;
+
+typedef struct tDopplerPacketHeader
+{
+	uint32_t	magic;			/* DOPPLER_STREAM_MAGIC */
+	uint8_t		version;		/* DOPPLER_STREAM_VERSION */
+	uint8_t		headerSize;		/* bytes before the first sample frame */
+	uint8_t		channelCount;
+	uint8_t		sampleFormat;	/* DOPPLER_SAMPLE_FORMAT */
+	uint32_t	sequence;		/* incremented by one for every datagram */
+	uint32_t	sampleRate;		/* samples per second, per channel */
+	uint64_t	firstSample;	/* index of the first frame since streaming started */
+	uint32_t	sampleCount;	/* sample frames in this datagram */
+	uint32_t	flags;			/* DOPPLER_FLAG_* */
+} DOPPLER_PACKET_HEADER;		/* 32 bytes */
+
+typedef struct tDopplerChannelHeader
+{
+	uint8_t		channel;		/* 0 = A, 1 = B, ... */
+	uint8_t		DCcoupled;
+	uint16_t	rangeMv;		/* full scale input range in mV */
+	int16_t		maxValue;		/* ADC count corresponding to rangeMv */
+	uint16_t	reserved;
+} DOPPLER_CHANNEL_HEADER;		/* 8 bytes */
+
+static inline uint32_t dopplerSampleSize(uint8_t sampleFormat)
+{
+	switch (sampleFormat)
+	{
+	case DOPPLER_FORMAT_S32_MV:		return 4;
+	case DOPPLER_FORMAT_S16_ADC:	return 2;
+	default:						return 0;
+	}
+}
+
+static inline uint32_t dopplerHeaderSize(uint8_t channelCount)
+{
+	return sizeof(DOPPLER_PACKET_HEADER) + channelCount * sizeof(DOPPLER_CHANNEL_HEADER);
+}
+
+#endif